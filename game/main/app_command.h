@@ -5,14 +5,19 @@
 
 #define CMD_BLOCK_SIZE 256
 #define CMD_HASH_SIZE 32
+#define CMD_EC_SIG_SIZE 64	// raw r|s of an ECDSA P-256 signature
 
 #define COMMAND_TIME 0x01
 #define COMMAND_TEST 0x02
+#define COMMAND_BATCH 0x03
 
 #define CMD_HEADER_SIZE    12  // after which contents start
 
 #define RESERVED_SOURCE		0
 #define RESERVED_LENGTH		1
+#define RESERVED_BATCH		2	// on the wire: non-zero for a batch member
+
+#define CMD_BATCH_MAX		8	// commands covered by one batch signature
 
 typedef struct __attribute__((__packed__))
 {
@@ -29,9 +34,41 @@ typedef struct __attribute__((__packed__))
 	uint8_t		sig_part[CMD_BLOCK_SIZE / 2];
 } cmd_signature_t;
 
+/*
+ *  Single-frame signature, sent with the SIG_FRONT bits.  It is told
+ *  apart from an RSA front half by hash_key naming the ECDSA key.
+ */
+typedef struct __attribute__((__packed__))
+{
+	uint8_t		hash_key[CMD_HASH_SIZE];
+	uint8_t		hash_msg[CMD_HASH_SIZE];
+	uint8_t		sig[CMD_EC_SIG_SIZE];
+	uint8_t		reserved[CMD_BLOCK_SIZE / 2 - CMD_EC_SIG_SIZE];
+} cmd_ec_signature_t;
+
+/*
+ *  Contents of a COMMAND_BATCH packet.  The batch members are ordinary
+ *  command frames with reserved[RESERVED_BATCH] set, sequence numbers
+ *  first_sequence .. first_sequence+count-1 and no signature of their own,
+ *  sent ahead of this packet.  hash_list is the SHA256 over the concatenated
+ *  frame hashes of the members in sequence order; the batch packet is
+ *  then signed as usual, so one RSA verification covers all of them.
+ */
+typedef struct __attribute__((__packed__))
+{
+	uint64_t	first_sequence;   /* 8 octets */
+	uint8_t		count;            /* 1 octet  */
+	uint8_t		reserved[3];      /* 3 octets */
+	uint8_t		hash_list[CMD_HASH_SIZE];
+} cmd_batch_t;
+
 void cmd_init(const char* rsa_public_key);
 void cmd_free();
 
+// Extra master keys, RSA-2048 or ECDSA P-256 PEM; each has its own sequence.
+int  cmd_add_key(const char* public_key);
+int  cmd_load_keys(void);   // from NVS and the key partition
+
 // Compute the SHA256 on data[size], result to out[32]
 int cmd_hash(const uint8_t* data, size_t size, uint8_t* out);
 
@@ -39,4 +76,7 @@ int cmd_hash(const uint8_t* data, size_t size, uint8_t* out);
 void cmd_inbound(const lownet_frame_t* frame);
 void cmd_dispatch(const cmd_packet_t* command);
 
+// Verify speed and command latency of both signature schemes, to serial.
+int  cmd_benchmark(void);
+
 #endif
@@ -1,20 +1,119 @@
 
-void cmd_abandon_cb(void* param) {
+// Returns 0 on equality.
+inline int hash_compare(const uint8_t* hash, const uint8_t* ref) {
+	return memcmp(hash, ref, CMD_HASH_SIZE);
+}
+
+/*
+ *  Session table and timer wheel helpers.  Everything that touches the
+ *  table or the wheel is called with local->lock held.
+ */
+
+void cmd_session_clear(cmd_session_t* s) {
+	memset((uint8_t*)s, 0, sizeof(cmd_session_t));
+	s->next = -1;
+	s->key  = -1;
+}
+
+void cmd_wheel_arm(cmd_session_t* s) {
+	int8_t idx = (int8_t)(s - local->session);
+
+	s->slot = (local->wheel_now + CMD_LISTEN_TICKS) % CMD_WHEEL_SLOTS;
+	s->next = local->wheel[s->slot];
+	local->wheel[s->slot] = idx;
+}
+
+void cmd_wheel_unlink(cmd_session_t* s) {
+	int8_t  idx = (int8_t)(s - local->session);
+	int8_t* pp  = &local->wheel[s->slot];
+
+	// Slot lists are at most CMD_MAX_SESSIONS long.
+	while (*pp >= 0 && *pp != idx) {
+		pp = &local->session[(int)*pp].next;
+	}
+	if (*pp == idx) {
+		*pp = s->next;
+	}
+	s->next = -1;
+}
+
+cmd_session_t* cmd_session_find(const uint8_t* hash_message) {
+	for (int i = 0; i < CMD_MAX_SESSIONS; ++i) {
+		cmd_session_t* s = &local->session[i];
+		if (s->flags != SESSION_FREE && !hash_compare(s->hash_message, hash_message)) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+cmd_session_t* cmd_session_open(const uint8_t* hash_message) {
+	for (int i = 0; i < CMD_MAX_SESSIONS; ++i) {
+		cmd_session_t* s = &local->session[i];
+		if (s->flags == SESSION_FREE) {
+			memcpy(s->hash_message, hash_message, CMD_HASH_SIZE);
+			s->key    = -1;
+			s->opened = esp_timer_get_time();
+			cmd_wheel_arm(s);
+			return s;
+		}
+	}
+	ESP_LOGW(TAG, "All command sessions busy");
+	return NULL;
+}
+
+// Periodic wheel tick: everything armed in the slot we turn to has timed out.
+void cmd_wheel_cb(void* param) {
 	if (!local) { return; }
 
-	// Abandon any listening in progress and revert to IDLE.
-	if (!param && local->state != STATE_IDLE) {
-		esp_timer_stop(local->timeout);
+	taskENTER_CRITICAL(&local->lock);
+	local->wheel_now++;
+	uint8_t slot = local->wheel_now % CMD_WHEEL_SLOTS;
+	int8_t  idx  = local->wheel[slot];
+	local->wheel[slot] = -1;
+	while (idx >= 0) {
+		cmd_session_t* s = &local->session[(int)idx];
+		idx = s->next;
+		cmd_session_clear(s);
 	}
-	local->state = STATE_IDLE;
-	memset(local->hash_message, 0, CMD_HASH_SIZE);
-	memset(local->signature, 0, CMD_BLOCK_SIZE);
-	memset(local->decrypted, 0, CMD_BLOCK_SIZE);
-	memset((uint8_t*)&local->command, 0, sizeof(cmd_packet_t));
+	taskEXIT_CRITICAL(&local->lock);
 }
 
+// Abandon all listening in progress.
 void cmd_abandon() {
-	cmd_abandon_cb(NULL);
+	taskENTER_CRITICAL(&local->lock);
+	for (int i = 0; i < CMD_MAX_SESSIONS; ++i) {
+		cmd_session_clear(&local->session[i]);
+	}
+	memset(local->wheel, -1, sizeof(local->wheel));
+	taskEXIT_CRITICAL(&local->lock);
+}
+
+/*
+ *  Key table helpers; the key table only changes while loading keys.
+ */
+cmd_key_t* cmd_key_find(const uint8_t* hash_key) {
+	int i = hash_key[0] & (CMD_KEY_SLOTS - 1);
+
+	while (local->key_index[i] >= 0) {
+		cmd_key_t* k = &local->key[(int)local->key_index[i]];
+		if (!hash_compare(k->hash_key, hash_key)) {
+			return k;
+		}
+		i = (i + 1) & (CMD_KEY_SLOTS - 1);
+	}
+	return NULL;
+}
+
+void cmd_key_advance(cmd_key_t* k, uint64_t sequence) {
+	k->last_sequence = sequence;
+
+	local->min_sequence = k->last_sequence;
+	for (int i = 0; i < local->keys; ++i) {
+		if (local->key[i].last_sequence < local->min_sequence) {
+			local->min_sequence = local->key[i].last_sequence;
+		}
+	}
 }
 
 uint8_t cmd_signing_header(uint8_t proto) {
@@ -22,8 +121,3 @@ uint8_t cmd_signing_header(uint8_t proto) {
 	return ((proto & 0b11000000) >> 6);
 }
 
-
-// Returns 0 on equality.
-inline int hash_compare(const uint8_t* hash, const uint8_t* ref) {
-	return memcmp(hash, ref, CMD_HASH_SIZE);
-}
\ No newline at end of file
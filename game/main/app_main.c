@@ -1,6 +1,7 @@
 // CSTDLIB includes.
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <esp_log.h>
 #include <esp_random.h>
@@ -21,6 +22,8 @@
 #include "esp_timer.h"
 
 #include "gameserver.h"
+#include "journal.h"
+#include "loadgen.h"
 
 const char* ERROR_OVERRUN = "ERROR // INPUT OVERRUN";
 const char* ERROR_UNKNOWN = "ERROR // PROCESSING FAILURE";
@@ -39,6 +42,13 @@ const char master_public[] =
 	"rwIDAQAB\n"
 	"-----END PUBLIC KEY-----";
 
+// Master node ECDSA P-256 key for single-frame command signatures.
+const char master_public_ec[] =
+	"-----BEGIN PUBLIC KEY-----\n"
+	"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEyQn4VnZu2dJuU9001EVEhHQFAnxy\n"
+	"+opekSumQ0vnNw6Hyt3W6hOgteN1MDHEIS3E2BDUB8p4tAH4gGB+e+yDsw==\n"
+	"-----END PUBLIC KEY-----";
+
 
 void app_frame_dispatch(const lownet_frame_t* frame)
 {
@@ -225,10 +235,21 @@ void print_usage( void )
             " /reboot       : reboot the device",
             " /ping # [msg] : ping node # with [msg] (optional), e.g. /ping 0xf0 foo",
             " /game #       : register to game at server #",
+            " /leaders [#]  : leaderboard of this game server, or of server #",
+            " /watch [# n]  : follow game n at server #, or stop following",
+            " /journal      : export the completed games in the journal",
+            " /tourney #    : join the tournament at server #",
+            " /tourney [rr|swiss n|start] : run a tournament here, or its standings",
+            " /loadgen # n [ms [fixed|uniform|exp]] : n virtual players on server #",
+            " /loadgen [stop] : load generator report, or stop it",
+            " /engine [ab|mcts] : engine for our moves, alpha-beta or Monte Carlo",
             " ----------------------------------------------------------------------",
             " /aes          : test AES frame encryption (set key first)",
             " /tsign        : test SHA256 and RSA with the public key",
             " /rsa          : test RSA function",
+            " /cmdbench     : compare RSA and ECDSA command signatures",
+            " /gamebench    : game server actions/s for growing game tables",
+            " /enginebench  : nodes/s and playouts/s of the game engines",
             " /diffie       : test modular exponentiation used in Diffie-Helman",
             " ----------------------------------------------------------------------",
             0
@@ -316,6 +337,11 @@ int parse_command( const char *msg_in )
 
     if (!strcmp(msg_in, "/aes"    )) { return aes_two_way_test();   }
     if (!strcmp(msg_in, "/reboot" )) { esp_restart(); return -1;    }    
+    if (!strcmp(msg_in, "/cmdbench")) { return cmd_benchmark();     }
+    if (!strcmp(msg_in, "/gamebench")) { return gameserver_benchmark(); }
+    if (!strcmp(msg_in, "/enginebench")) { return game_engine_bench(); }
+    if (!strcmp(msg_in, "/leaders" )) { return gameserver_leaders();  }
+    if (!strcmp(msg_in, "/journal" )) { return journal_export();      }
     //if (!strcmp(msg_in, "/tsign"  )) { return signature_test( my_hash, my_rsa ); }
 
     if (!strncmp(msg_in, "/game 0x", 8)) {
@@ -327,6 +353,83 @@ int parse_command( const char *msg_in )
             return 0;
         }
     }
+    if (!strncmp(msg_in, "/leaders 0x", 11)) {
+        const char *arg = msg_in + 11;
+        uint32_t x;
+        if ( (arg=hex2dec( arg, &x )) && x > 0 && x < 0xff )
+        {
+            game_leaders( x );
+            return 0;
+        }
+    }
+    if (!strncmp(msg_in, "/tourney 0x", 11)) {
+        const char *arg = msg_in + 11;
+        uint32_t x;
+        if ( (arg=hex2dec( arg, &x )) && x > 0 && x < 0xff )
+        {
+            game_tourney( x );
+            return 0;
+        }
+    }
+    if (!strncmp(msg_in, "/tourney", 8) && (msg_in[8] == ' ' || !msg_in[8])) {
+        if ( gameserver_tourney( msg_in + 8 ) )
+        {
+            serial_write_line("Usage: /tourney [rr|swiss n|start] on a game server");
+            return -1;
+        }
+        return 0;
+    }
+    if (!strcmp(msg_in, "/loadgen"     )) { return loadgen_report(); }
+    if (!strcmp(msg_in, "/loadgen stop")) { loadgen_stop(); return loadgen_report(); }
+    if (!strncmp(msg_in, "/loadgen 0x", 11)) {
+        const char *arg = msg_in + 11;
+        uint32_t x;
+        loadgen_conf_t c = { 0, 0, LOADGEN_EXP, 500 };
+        char *end;
+
+        unsigned long n;
+
+        if ( (arg=hex2dec( arg, &x )) && x > 0 && x < 0xff && *arg == ' ' &&
+             (n = strtoul( arg, &end, 10 )) > 0 && n <= LOADGEN_PLAYERS )
+        {
+            c.server  = x;
+            c.players = n;
+            if ( *end == ' ' )
+                c.think_ms = strtoul( end, &end, 10 );
+            if ( !strcmp( end, " fixed" ) )
+                c.dist = LOADGEN_FIXED;
+            else if ( !strcmp( end, " uniform" ) )
+                c.dist = LOADGEN_UNIFORM;
+            if ( !loadgen_start( &c ) )
+                return 0;
+        }
+        serial_write_line("Usage: /loadgen # n [ms [fixed|uniform|exp]], at most 64 players");
+        return -1;
+    }
+    if (!strncmp(msg_in, "/engine", 7) && (msg_in[7] == ' ' || !msg_in[7])) {
+        int e = !strcmp(msg_in + 7, " ab")   ? TICTAC_POLICY_AB :
+                !strcmp(msg_in + 7, " mcts") ? TICTAC_POLICY_MCTS : -1;
+        if ( e < 0 && msg_in[7] )
+        {
+            serial_write_line("Usage: /engine [ab|mcts]");
+            return -1;
+        }
+        serial_write_line( tictac_policy( e ) == TICTAC_POLICY_MCTS ? "Engine: mcts" : "Engine: ab" );
+        return 0;
+    }
+    if (!strcmp(msg_in, "/watch")) {
+        game_watch( 0, 0 );
+        return 0;
+    }
+    if (!strncmp(msg_in, "/watch 0x", 9)) {
+        const char *arg = msg_in + 9;
+        uint32_t x;
+        if ( (arg=hex2dec( arg, &x )) && x > 0 && x < 0xff && *arg == ' ' )
+        {
+            game_watch( x, strtoul( arg, 0, 10 ) );
+            return 0;
+        }
+    }
     if (!strcmp(msg_in, "/status")) {
         char buf[80];
         void send_buf( void )
@@ -394,6 +497,8 @@ void app_main(void)
     lownet_set_time(&init_time);
 
     cmd_init( master_public );
+    cmd_add_key( master_public_ec );
+    cmd_load_keys();
 
     game_init(); // master_init( );    // master node init / autotest    
 
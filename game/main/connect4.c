@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "games.h"
+#include "tictactoe.h"
+#include "gameengine.h"
+#include "connect4.h"
+
+#define H1  (CONNECT4_ROWS + 1)     // bits per column
+
+static void mark( connect4_t *c, int x, int y, uint8_t s )
+{
+    c->pos[s-1] |= 1ull << (H1*x + y);
+    c->moves++;
+    c->digest   ^= tictac_dcell( x, y, s );
+    c->last_x[0] = c->last_x[1];
+    c->last_y[0] = c->last_y[1];
+    c->last_x[1] = x;
+    c->last_y[1] = y;
+}
+
+int connect4_drop( connect4_t *c, int col, uint8_t s )
+{
+    int y;
+
+    if ( col < 0 || col >= CONNECT4_COLS || !s || s>2 ||
+         (y = c->height[col]) >= CONNECT4_ROWS )
+        return -1;
+    c->height[col]++;
+    mark( c, col, y, s );
+    return y;
+}
+
+int connect4_won( uint64_t b )
+{
+    static const int dir[4] = { 1, H1, H1-1, H1+1 };
+
+    for( int i=0; i<4; i++ )
+    {
+        uint64_t m = b & (b >> dir[i]);
+        if ( m & (m >> 2*dir[i]) )
+            return 1;
+    }
+    return 0;
+}
+
+/********************************************************************************/
+
+static void c4_init( void *state )
+{
+    memset( state, 0, sizeof(connect4_t) );
+}
+
+/*
+ *  The column is x, the row it lands on comes back in y
+ */
+static int c4_move( void *state, int *x, int *y, uint8_t s )
+{
+    int row = connect4_drop( (connect4_t *)state, *x, s );
+
+    if ( row < 0 )
+        return -1;
+    *y = row;
+    return 0;
+}
+
+/*
+ *  Replay: the square as journaled, whatever the order of the records
+ */
+static int c4_place( void *state, int x, int y, uint8_t s )
+{
+    connect4_t *c = (connect4_t *)state;
+
+    if ( x < 0 || x >= CONNECT4_COLS || y < 0 || y >= CONNECT4_ROWS || !s || s>2 ||
+         ((c->pos[0] | c->pos[1]) & (1ull << (H1*x + y))) )
+        return -1;
+    if ( y >= c->height[x] )
+        c->height[x] = y + 1;
+    mark( c, x, y, s );
+    return 0;
+}
+
+static int c4_outcome( const void *state, void *work )
+{
+    const connect4_t *c = (const connect4_t *)state;
+
+    if ( connect4_won( c->pos[0] ) )
+        return GAME_OUTCOME_ONE;
+    if ( connect4_won( c->pos[1] ) )
+        return GAME_OUTCOME_TWO;
+    return c->moves == CONNECT4_COLS*CONNECT4_ROWS ? GAME_OUTCOME_TIE : GAME_OUTCOME_NONE;
+}
+
+/*
+ *  Square k = x + 7y in bits 2*(k%4) of octet k/4, as tictactoe_packed_t
+ */
+static int c4_encode( const void *state, void *work, uint8_t *buf )
+{
+    const connect4_t *c = (const connect4_t *)state;
+
+    memset( buf, 0, CONNECT4_PACKED );
+    for( int x=0; x<CONNECT4_COLS; x++ )
+    {
+        for( int y=0; y<c->height[x]; y++ )
+        {
+            uint64_t bit = 1ull << (H1*x + y);
+            int      k   = x + CONNECT4_COLS*y;
+            uint8_t  s   = (c->pos[0] & bit) ? 1 : (c->pos[1] & bit) ? 2 : 0;
+
+            buf[k/4] |= s << 2*(k%4);
+        }
+    }
+    return CONNECT4_PACKED;
+}
+
+static void c4_delta( const void *state, game_delta_t *gd )
+{
+    const connect4_t *c = (const connect4_t *)state;
+
+    for( int i=0; i<GAME_DELTA_MOVES; i++ )
+    {
+        gd->move_x[i] = c->last_x[i];
+        gd->move_y[i] = c->last_y[i];
+    }
+    gd->digest = c->digest;
+}
+
+const game_engine_t connect4_engine =
+{
+    .game       = GAME_CONNECT4,
+    .name       = "connect-four",
+    .state_size = sizeof(connect4_t),
+    .width      = CONNECT4_COLS,
+    .init       = c4_init,
+    .move       = c4_move,
+    .place      = c4_place,
+    .verify     = NULL,     // no checksum defined for it
+    .outcome    = c4_outcome,
+    .encode     = c4_encode,
+    .delta      = c4_delta,
+};
@@ -0,0 +1,33 @@
+#ifndef CONNECT4_H
+#define CONNECT4_H
+
+#include <stdint.h>
+
+/*
+ *  Connect-Four on bitboards
+ *
+ *  One 64-bit board per player, column c in bits 7c .. 7c+5 from the
+ *  bottom up.  Bit 7c+6 stays empty so that the shifts of the win
+ *  check never carry from one column to the next: four in a row in
+ *  direction d is  m = b & (b >> d),  m & (m >> 2d)  for d = 1
+ *  (vertical), 7 (horizontal), 6 and 8 (the diagonals).
+ */
+
+#define CONNECT4_COLS      7
+#define CONNECT4_ROWS      6
+#define CONNECT4_PACKED   11    // full status, 2 bits per square
+
+typedef struct
+{
+    uint64_t  pos[2];                   // pieces of player 1 and 2
+    uint8_t   height[ CONNECT4_COLS ];  // pieces in the column
+    uint8_t   moves;
+    uint8_t   last_x[2];                // newest in [1]
+    uint8_t   last_y[2];
+    uint32_t  digest;                   // XOR of tictac_dcell() as for tictactoe
+} connect4_t;
+
+int connect4_drop( connect4_t *c, int col, uint8_t s );  // row of the piece, -1 if the column is full
+int connect4_won(  uint64_t b );
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "games.h"
+#include "tictactoe.h"
+#include "gameengine.h"
+
+/*
+ *  Tictactoe state: the 2-bit packed board, its CRC as in the actions
+ *  and what delta statuses need, the board digest and the last two
+ *  moves
+ */
+typedef struct
+{
+    tictactoe_packed_t  board;
+    uint32_t            check;      // tictac_checksum() of the board
+    uint32_t            digest;     // tictac_digest() of the board
+    uint8_t             last_x[2];  // newest in [1]
+    uint8_t             last_y[2];
+} tictac_state_t;
+
+static void tt_init( void *state )
+{
+    memset( state, 0, sizeof(tictac_state_t) );
+    ((tictac_state_t *)state)->check = tictac_checksum_empty();
+}
+
+static int tt_place( void *state, int x, int y, uint8_t s )
+{
+    tictac_state_t *t = (tictac_state_t *)state;
+
+    if ( x < 0 || x >= TICTACTOE_BOARD ||
+         y < 0 || y >= TICTACTOE_BOARD ||
+         !s || s>2 ||
+         tictac_pset( &t->board, x, y, s ) )    // failure -- square already marked?
+        return -1;
+    t->check     = tictac_checksum_move( t->check, x, y, s );
+    t->digest   ^= tictac_dcell( x, y, s );
+    t->last_x[0] = t->last_x[1];
+    t->last_y[0] = t->last_y[1];
+    t->last_x[1] = x;
+    t->last_y[1] = y;
+    return 0;
+}
+
+static int tt_move( void *state, int *x, int *y, uint8_t s )
+{
+    return tt_place( state, *x, *y, s );
+}
+
+/*
+ *  The client sends the checksum of its board with the move on it: one
+ *  octet of the packing changes, so this is O(1)
+ */
+static int tt_verify( const void *state, int x, int y, uint8_t s, uint32_t checksum )
+{
+    const tictac_state_t *t = (const tictac_state_t *)state;
+
+    if ( x < 0 || x >= TICTACTOE_BOARD || y < 0 || y >= TICTACTOE_BOARD || !s || s>2 )
+        return 0;   // illegal anyway, move() says so
+    return tictac_checksum_move( t->check, x, y, s ) == checksum ? 0 : -1;
+}
+
+/*
+ *  Only lines through the last move can have changed
+ */
+static int tt_outcome( const void *state, void *work )
+{
+    const tictac_state_t *t = (const tictac_state_t *)state;
+    int                   r = tictac_pcheck_move( &t->board, t->last_x[1], t->last_y[1] );
+
+#if GAME_CHECK_SCAN
+    tictac_unpack( &t->board, (tictactoe_t *)work );
+    if ( tictac_game_over( (tictactoe_t *)work ) != r )
+        printf( "Oops, last move (%d,%d) says %d, the board %d\n",
+                t->last_x[1], t->last_y[1], r, tictac_game_over( (tictactoe_t *)work ) );
+#endif
+    return r;
+}
+
+static int tt_encode( const void *state, void *work, uint8_t *buf )
+{
+    tictac_unpack( &((const tictac_state_t *)state)->board, (tictactoe_t *)work );
+    tictac_encode( (tictactoe_t *)work, (tictactoe_payload_t *)buf );
+    return sizeof(tictactoe_payload_t);
+}
+
+static void tt_delta( const void *state, game_delta_t *gd )
+{
+    const tictac_state_t *t = (const tictac_state_t *)state;
+
+    for( int i=0; i<GAME_DELTA_MOVES; i++ )
+    {
+        gd->move_x[i] = t->last_x[i];
+        gd->move_y[i] = t->last_y[i];
+    }
+    gd->digest = t->digest;
+}
+
+const game_engine_t tictac_engine =
+{
+    .game       = GAME_TICTACTOE,
+    .name       = "tictactoe",
+    .state_size = sizeof(tictac_state_t),
+    .width      = TICTACTOE_BOARD,
+    .init       = tt_init,
+    .move       = tt_move,
+    .place      = tt_place,
+    .verify     = tt_verify,
+    .outcome    = tt_outcome,
+    .encode     = tt_encode,
+    .delta      = tt_delta,
+};
+
+/********************************************************************************/
+
+const game_engine_t *const game_engines[ GAME_ENGINES ] =
+{
+    &tictac_engine,
+    &connect4_engine,
+};
+
+int game_engine_index( uint8_t game )
+{
+    for( int i=0; i<GAME_ENGINES; i++ )
+        if ( game_engines[i]->game == game )
+            return i;
+    return -1;
+}
+
+const game_engine_t *game_engine( uint8_t game )
+{
+    int i = game_engine_index( game );
+    return i < 0 ? NULL : game_engines[i];
+}
@@ -0,0 +1,52 @@
+#ifndef GAMEENGINE_H
+#define GAMEENGINE_H
+
+#include <stdint.h>
+
+#include "games.h"
+#include "tictactoe.h"
+
+/*
+ *  Game engines of the game server
+ *
+ *  Everything game specific goes through the engine of the game: the
+ *  server keeps the state of a game in game_t.data, in the engine's
+ *  own layout, and knows nothing of boards.  A move is (x,y); an
+ *  engine may use x only, e.g. a column, and tells where it landed.
+ *
+ *  outcome() and encode() get a per-shard scratch area of
+ *  GAME_WORK_SIZE octets.
+ */
+
+#define GAME_OUTCOME_NONE   0
+#define GAME_OUTCOME_ONE    1   // player 1 won
+#define GAME_OUTCOME_TWO    2
+#define GAME_OUTCOME_TIE    3
+
+#define GAME_WORK_SIZE      sizeof(tictactoe_t)
+#define GAME_CHECK_SCAN     0   // 1: cross-check the last-move win test with a full scan
+#define GAME_ENGINES        2
+
+typedef struct
+{
+    uint8_t      game;          // GAME_xyz
+    const char  *name;
+    uint16_t     state_size;    // octets of game_t.data in use
+    uint8_t      width;         // moves have x < width
+    void       (*init)(    void *state );                                // new game
+    int        (*move)(    void *state, int *x, int *y, uint8_t s );    // validate and apply, -1 if illegal
+    int        (*place)(   void *state, int x, int y, uint8_t s );      // journal replay, no rules
+    int        (*verify)(  const void *state, int x, int y, uint8_t s, uint32_t checksum );  // of the board after, -1 if off
+    int        (*outcome)( const void *state, void *work );             // GAME_OUTCOME_xyz
+    int        (*encode)(  const void *state, void *work, uint8_t *buf );  // full status, returns its length
+    void       (*delta)(   const void *state, game_delta_t *gd );       // the last moves and the digest
+} game_engine_t;
+
+extern const game_engine_t  tictac_engine;
+extern const game_engine_t  connect4_engine;
+extern const game_engine_t *const game_engines[ GAME_ENGINES ];
+
+const game_engine_t *game_engine( uint8_t game );        // NULL if we do not have it
+int                  game_engine_index( uint8_t game );  // into game_engines[], -1 if none
+
+#endif
@@ -14,6 +14,10 @@
 #include "serial_io.h"
 
 #include "gameserver.h"  // only our nodes can do both!
+#include "loadgen.h"
+#include "tictac_search.h"
+#include "tictac_mcts.h"
+#include "tictac_book.h"
 
 #define TAG "games.c"
 
@@ -28,13 +32,48 @@
 #define GAME_ACTIVE      3  /* a game is ongoing      */
 #define GAME_OVER        4  /* and then ended         */
 
+#define THINK_MS      3000  /* a move of ours           */
+#define PONDER_MS     6000  /* ..theirs, past the server's 5 s they lose */
+
+#define PONDER_IDLE      0
+#define PONDER_ON        1  /* searching the predicted reply */
+#define PONDER_HIT       2  /* ..which came, so for THINK_MS more */
+#define PONDER_MISS      3  /* another one came, stopped */
+#define PONDER_DONE      4  /* finished before any came */
+
 /*
  * the current game
  */
 static game_status_t current;       // latest game status
 static tictactoe_t   tictactoe;     // easily accessible representation of the board
 static uint8_t       server   = 0;  // node id of the server
+static uint8_t       reg_type = 0;  // how we registered to it, GAME_PACKET_REGISTER or _TOURNEY
 static uint8_t       status   = 0;  // current state, GAME_xyz
+static uint32_t      digest   = 0;  // tictac_digest( &tictactoe ), kept up to date
+static portMUX_TYPE  board_lock = portMUX_INITIALIZER_UNLOCKED;  // the three above, written by two tasks
+
+/*
+ * the game we watch, if any
+ */
+static struct
+{
+    uint32_t     seq;     // 0 = none
+    uint8_t      server;
+    uint32_t     digest;
+    tictactoe_t  board;
+} watch;
+
+/*
+ * pondering: the policy task searches our answer to the predicted
+ * reply while the opponent thinks, game_receive() tells it how it went
+ */
+static struct
+{
+    volatile uint32_t  until;    // of the search, tictac_search_now() time
+    volatile uint8_t   state;    // PONDER_xyz
+    uint32_t           digest;   // of the board with the predicted reply
+    int                x, y;     // the answer
+} ponder;
 
 static SemaphoreHandle_t  game_turn; // half-broken synchronization method, fix!
 
@@ -69,9 +108,23 @@ void tictac_display_board( const tictactoe_t *ttt )
     serial_write_line( "\e8\e[A" );  
 }
 
+/*
+ *  Redraw one square of the board above
+ */
+void tictac_display_square( int x, int y, uint8_t s )
+{
+    char buf[24];
+
+    if ( !y )  // bottom row is not shown
+        return;
+    sprintf( buf, "\e7\e[%d;%dH%c\e8\e[A", TICTACTOE_BOARD - y, x + 1,
+             s==1 ? 'x' : s==2 ? 'o' : '_' );
+    serial_write_line( buf );
+}
+
 /******************************************************************************/
 
-void game_register( uint8_t snode )
+void send_register( uint8_t snode, uint8_t type )
 {
     lownet_frame_t pkt;
     game_register_t *reg = (game_register_t *)pkt.payload;
@@ -81,6 +134,7 @@ void game_register( uint8_t snode )
     
     //ESP_LOGI(TAG, "registering to game server 0x%02x", (unsigned int)snode );
     server   = snode;
+    reg_type = type;
     status   = GAME_REGISTERING;
     
     pkt.source      = lownet_get_device_id();
@@ -88,14 +142,140 @@ void game_register( uint8_t snode )
     pkt.protocol    = LOWNET_PROTOCOL_GAME;
     pkt.length      = sizeof(game_register_t);
         
-    reg->type   = GAME_PACKET_REGISTER;
+    reg->type   = type;
     reg->game   = GAME_TICTACTOE;
     reg->flags  = 0;
     reg->online = 0;
+    reg->queued = 0;
+    lownet_send( &pkt );
+}
+
+void game_register( uint8_t snode )
+{
+    send_register( snode, GAME_PACKET_REGISTER );
+}
+
+void game_tourney( uint8_t snode )
+{
+    send_register( snode, GAME_PACKET_TOURNEY );
+}
+
+void game_leaders( uint8_t snode )
+{
+    lownet_frame_t pkt;
+    game_msg_header_t *h = (game_msg_header_t *)pkt.payload;
+
+    pkt.source      = lownet_get_device_id();
+    pkt.destination = snode;
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = sizeof(game_msg_header_t);
+
+    h->type = GAME_PACKET_LEADERS;
+    h->game = GAME_TICTACTOE;
+    lownet_send( &pkt );
+}
+
+/*
+ *  Ask for the full status of game seq: GAME_PACKET_RESYNC when our
+ *  board went out of sync, GAME_PACKET_WATCH to start spectating
+ */
+void game_request( uint8_t snode, uint8_t type, uint32_t seq )
+{
+    lownet_frame_t pkt;
+    game_action_t *ga = (game_action_t *)pkt.payload;
+    uint8_t        me = lownet_get_device_id();
+
+    pkt.source      = me;
+    pkt.destination = snode;
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = sizeof(game_action_t);
+
+    memset( ga, 0, sizeof(game_action_t) );
+    ga->type = type;
+    ga->game = GAME_TICTACTOE;
+    ga->seq  = seq;
+    ga->node = me;
     lownet_send( &pkt );
 }
 
-int send_move( int x, int y ) 
+/*
+ *  Spectate game seq at server snode; seq 0 stops
+ */
+void game_watch( uint8_t snode, uint32_t seq )
+{
+    watch.seq    = seq;
+    watch.server = snode;
+    if ( seq )
+        game_request( snode, GAME_PACKET_WATCH, seq );
+}
+
+/*
+ *  Apply a delta status to board b with digest *d; -1 if it does
+ *  not add up
+ */
+int game_apply_delta( tictactoe_t *b, uint32_t *d, const game_delta_t *gd )
+{
+    if ( gd->moves > GAME_DELTA_MOVES || gd->round < gd->moves + 1 )
+        return -1;
+    for( int i=GAME_DELTA_MOVES - gd->moves; i<GAME_DELTA_MOVES; i++ )
+    {
+        int      x = gd->move_x[i];
+        int      y = gd->move_y[i];
+        uint32_t r = gd->round - GAME_DELTA_MOVES + i;  // round of the move
+        uint8_t  s = 2 - (r & 1);
+
+        if ( x >= TICTACTOE_BOARD || y >= TICTACTOE_BOARD )
+            return -1;
+        if ( tictac_get( b, x, y ) == s )  // ours, already there
+            continue;
+        if ( tictac_set( b, x, y, s ) )
+            return -1;
+        *d ^= tictac_dcell( x, y, s );
+        tictac_display_square( x, y, s );
+    }
+    return *d == gd->digest ? 0 : -1;
+}
+
+/*
+ *  Status of the game we watch
+ */
+void game_spectate( const lownet_frame_t *frame )
+{
+    const game_status_t *gs = (const game_status_t *)frame->payload;
+    char buf[80];
+
+    if ( gs->type == GAME_PACKET_DELTA )
+    {
+        if ( game_apply_delta( &watch.board, &watch.digest, (const game_delta_t *)gs ) )
+            game_request( watch.server, GAME_PACKET_RESYNC, watch.seq );
+        return;
+    }
+    tictac_decode( (const tictactoe_payload_t *)&frame->payload[GAME_STATUS_HEADER], &watch.board );
+    watch.digest = tictac_digest( &watch.board );
+    tictac_display_board( &watch.board );
+    if ( gs->type == GAME_PACKET_STATUS )
+        return;
+
+    snprintf( buf, 80, "Game %lu over: %s", (unsigned long)gs->seq,
+              gs->type == GAME_PACKET_TIE      ? "tie" :
+              gs->type == GAME_PACKET_WINNER_1 ? "player 1 won" : "player 2 won" );
+    serial_write_line( buf );
+    watch.seq = 0;
+}
+
+/*
+ *  Status packets are broadcast: is this one about our game?
+ */
+int my_game( const game_status_t *gs )
+{
+    uint8_t me = lownet_get_device_id();
+
+    if ( status == GAME_WAITING || status == GAME_REGISTERING )   // a pairing may beat the ACK
+        return gs->node_1 == me || gs->node_2 == me;
+    return status >= GAME_ACTIVE && gs->seq == current.seq;
+}
+
+int send_move( int x, int y, const tictactoe_t *b )
 {
     lownet_frame_t pkt;
     game_action_t *ga = (game_action_t *)pkt.payload;
@@ -114,13 +294,62 @@ int send_move( int x, int y )
     ga->move_x      = x;
     ga->move_y      = y;
     ga->flags       = 0;
-    ga->checksum    = tictac_checksum( &tictactoe );  /* the move already on board! */
+    ga->checksum    = tictac_checksum( b );  /* the move already on board! */
 
     //ESP_LOGW(TAG, "sending the move" );
     lownet_send( &pkt );
     return 0;
 }
 
+/*
+ *  s has moved in round on board b with digest d, a copy taken before
+ *  the move was sent: search the answer to the reply the search expects
+ *  (or tictac_auto()'s if it has none) until game_receive() tells a hit
+ *  from a miss.  Alpha-beta only, MCTS starts afresh anyway.
+ */
+static void ponder_move( uint8_t s, tictactoe_t *b, uint32_t d, uint32_t round )
+{
+    int p = tictac_search_reply( b ), x, y;
+
+    ponder.state = PONDER_IDLE;
+    if ( tictac_policy( -1 ) != TICTAC_POLICY_AB )
+        return;
+    if ( p >= 0 )
+    {
+        x = p % TICTACTOE_BOARD;
+        y = p / TICTACTOE_BOARD;
+    }
+    else if ( tictac_auto( b, &x, &y, 3-s ) )
+        return;
+    if ( tictac_set( b, x, y, 3-s ) || tictac_check_move( b, x, y ) )
+        return;   // nothing to answer
+
+    ponder.digest = d ^ tictac_dcell( x, y, 3-s );
+    ponder.until  = tictac_search_now() + PONDER_MS;
+    ponder.state  = PONDER_ON;
+    if ( status != GAME_ACTIVE || (current.round != round && current.round != round+1) )   // theirs is round+2
+    {
+        ponder.state = PONDER_IDLE;   // too late, game_receive() did not see it on
+        return;
+    }
+    if ( tictac_ponder( b, &ponder.x, &ponder.y, s, &ponder.until, NULL ) )
+        ponder.state = PONDER_IDLE;
+    else if ( ponder.state == PONDER_ON )
+        ponder.state = PONDER_DONE;
+}
+
+/*
+ *  The opponent has moved, or the game is over: on the predicted board
+ *  the ponder search gets the time of a move, else it stops at once
+ */
+static void ponder_reply( int hit )
+{
+    if ( ponder.state != PONDER_ON )
+        return;
+    ponder.until = tictac_search_now() + (hit ? THINK_MS - THINK_MS/10 : 0);
+    ponder.state = hit ? PONDER_HIT : PONDER_MISS;
+}
+
 /*
  *  This task is always ready to make one more move!
  */
@@ -146,21 +375,52 @@ void my_policy( void *p )
         {
             case GAME_PACKET_STATUS:    // game active
             {
-                uint8_t me = lownet_get_device_id();
-                uint8_t s  = 2 - (current.round & 1);
+                uint8_t       me = lownet_get_device_id();
+                game_status_t gs;
+                tictactoe_t   b;
+                uint32_t      d;
+                uint8_t       s;
                 int x, y;
 
-                if ( (s==1 && current.node_1 == me) ||
-                     (s==2 && current.node_2 == me) )
+                /* search and validate on a copy, game_receive() may store the next status */
+                taskENTER_CRITICAL( &board_lock );
+                gs = current;
+                b  = tictactoe;
+                d  = digest;
+                taskEXIT_CRITICAL( &board_lock );
+                s  = 2 - (gs.round & 1);
+
+                if ( (s==1 && gs.node_1 == me) ||
+                     (s==2 && gs.node_2 == me) )
                 {
-                    vTaskDelay( 200 / portTICK_PERIOD_MS);
-                    if ( !tictac_move( &tictactoe, &x, &y, s, 3000) &&
+                    int hit = (ponder.state == PONDER_HIT || ponder.state == PONDER_DONE) &&
+                              ponder.digest == d;
+
+                    if ( hit )
+                    {
+                        x = ponder.x;
+                        y = ponder.y;
+                    }
+                    else
+                        vTaskDelay( 200 / portTICK_PERIOD_MS);
+                    ponder.state = PONDER_IDLE;
+                    if ( (hit || !tictac_move( &b, &x, &y, s, THINK_MS )) &&
                          x >= 0 && x < TICTACTOE_BOARD &&
-                         y >= 0 && y < TICTACTOE_BOARD )
+                         y >= 0 && y < TICTACTOE_BOARD &&
+                         !tictac_get( &b, x, y ) )
                     {
                         /* make the move on board and send it */
-                        tictac_set( &tictactoe, x, y, s );
-                        send_move( x, y );
+                        tictac_set( &b, x, y, s );
+                        d ^= tictac_dcell( x, y, s );
+                        taskENTER_CRITICAL( &board_lock );
+                        if ( current.seq == gs.seq && current.round == gs.round )
+                        {
+                            tictactoe = b;
+                            digest    = d;
+                        }
+                        taskEXIT_CRITICAL( &board_lock );
+                        send_move( x, y, &b );
+                        ponder_move( s, &b, d, gs.round );
                     }
                     else
                     {
@@ -188,6 +448,8 @@ void game_receive( const lownet_frame_t *frame )
 {
     const game_msg_header_t *g = (const game_msg_header_t *)frame->payload;
 
+    if ( loadgen_receive( frame ) )   /*  For one of our virtual players  */
+        return;
     if ( gameserver_active()>=0 )
     {
         gameserver_receive( frame );
@@ -201,6 +463,27 @@ void game_receive( const lownet_frame_t *frame )
     }
 
     //ESP_LOGW(TAG, "game protocol message from 0x%02x received (type %u)", frame->source, g->type );
+
+    /*  One broadcast for everybody: only our game and the one we watch  */
+    switch (g->type)
+    {
+        case GAME_PACKET_STATUS:
+        case GAME_PACKET_WINNER_1:
+        case GAME_PACKET_WINNER_2:
+        case GAME_PACKET_TIE:
+        case GAME_PACKET_DELTA:
+        {
+            const game_status_t *gs = (const game_status_t *)frame->payload;  // seq at the same place
+
+            if ( watch.seq && gs->seq == watch.seq && frame->source == watch.server )
+            {
+                game_spectate( frame );
+                return;
+            }
+            if ( frame->source != server || !my_game( gs ) )
+                return;
+        }
+    }
     
     switch (g->type)
     {
@@ -224,18 +507,18 @@ void game_receive( const lownet_frame_t *frame )
         case GAME_PACKET_TIE:       // and game over
         {
             const game_status_t *gs = (const game_status_t *)frame->payload;
+            tictactoe_t          b;
+            uint32_t             d;
 
-            if ( status != GAME_WAITING &&
-                 current.seq != gs->seq )
-            {
-                ESP_LOGW(TAG, "invalid game seq" );
-                return;
-            }
-            
-            /* store the state and decode the board */
-            current = *gs;
-            tictac_decode( (const tictactoe_payload_t *)&frame->payload[GAME_STATUS_HEADER], &tictactoe );
-            tictac_display_board( &tictactoe );
+            /* decode the board, then store it with the state */
+            tictac_decode( (const tictactoe_payload_t *)&frame->payload[GAME_STATUS_HEADER], &b );
+            d = tictac_digest( &b );
+            taskENTER_CRITICAL( &board_lock );
+            current   = *gs;
+            tictactoe = b;
+            digest    = d;
+            taskEXIT_CRITICAL( &board_lock );
+            tictac_display_board( &b );
             switch( g->type ) 
             {
                 case GAME_PACKET_STATUS:
@@ -247,22 +530,80 @@ void game_receive( const lownet_frame_t *frame )
                     //ESP_LOGW(TAG, "status packet: me=%02x next=%02x", (unsigned int)me, (unsigned int)next );
 
                     if ( next==me )
+                    {
+                        ponder_reply( d == ponder.digest );
                         xSemaphoreGive( game_turn );
+                    }
                     break;
                 }
                 case GAME_PACKET_WINNER_1:
                 case GAME_PACKET_WINNER_2:
                 case GAME_PACKET_TIE:
                     status = GAME_OVER;
-                    // FIX/CHECK: without delay game_register sometimes fails?!
-                    vTaskDelay( 100 / portTICK_PERIOD_MS); 
-                    game_register( 0xf0 );  // stress test, remove later FIX FIX
+                    ponder_reply( 0 );
+                    /* ready for the next one, the same way: a tournament
+                       member is ACKed again and paired when one is free */
+                    send_register( server, reg_type );
                     break;
             }
             break;
         }
+        case GAME_PACKET_DELTA:     // game active, just the last moves
+        {
+            const game_delta_t *gd = (const game_delta_t *)frame->payload;
+            tictactoe_t         b;
+            uint32_t            d;
+
+            taskENTER_CRITICAL( &board_lock );
+            b = tictactoe;
+            d = digest;
+            taskEXIT_CRITICAL( &board_lock );
+            if ( status != GAME_ACTIVE || current.seq != gd->seq ||
+                 game_apply_delta( &b, &d, gd ) )
+            {
+                ESP_LOGW(TAG, "delta does not match, resync" );
+                game_request( server, GAME_PACKET_RESYNC, gd->seq );
+                break;
+            }
+            taskENTER_CRITICAL( &board_lock );
+            tictactoe     = b;
+            digest        = d;
+            current.type  = GAME_PACKET_STATUS;
+            current.round = gd->round;
+            taskEXIT_CRITICAL( &board_lock );
+            {
+                uint8_t me = lownet_get_device_id();
+                uint8_t next = (gd->round & 1) ? gd->node_1 : gd->node_2;
+
+                if ( next==me )
+                {
+                    ponder_reply( d == ponder.digest );
+                    xSemaphoreGive( game_turn );
+                }
+            }
+            break;
+        }
+
         case  GAME_PACKET_ACTION:  // ACK or NACK, not handled ...  FIX THIS
             break;
+
+        case GAME_PACKET_LEADERS:
+        {
+            const game_leaders_t *gl = (const game_leaders_t *)frame->payload;
+            char buf[80];
+
+            if ( gl->count > GAME_LEADERS )
+                break;
+            snprintf( buf, 80, "Leaderboard of 0x%02x", (unsigned int)frame->source );
+            serial_write_line( buf );
+            for( int i=0; i<gl->count; i++ )
+            {
+                snprintf( buf, 80, " %2d. 0x%02x %5u (%u games)", i+1, (unsigned)gl->leader[i].node,
+                          (unsigned)gl->leader[i].rating, (unsigned)gl->leader[i].games );
+                serial_write_line( buf );
+            }
+            break;
+        }
             
         default:
             ESP_LOGW(TAG, "invalid message received" );
@@ -271,14 +612,60 @@ void game_receive( const lownet_frame_t *frame )
 }
 
 
+/*
+ *  A second of each engine on a position of the middle game, in a task
+ *  of its own for the stack the search needs.  Not while playing, the
+ *  engines keep their state in statics.
+ */
+static void engine_bench( void *arg )
+{
+    tictactoe_t    b;
+    search_stats_t ss;
+    mcts_stats_t   ms;
+    char           buf[80];
+    int            x, y;
+
+    memset( &b, 0, sizeof(b) );
+    tictac_set( &b, TICTACTOE_BOARD/2, TICTACTOE_BOARD/2, 1 );
+    for( int k=1; k<12; k++ )
+        if ( !tictac_auto( &b, &x, &y, 1 + (k & 1) ) )
+            tictac_set( &b, x, y, 1 + (k & 1) );
+
+    tictac_search( &b, &x, &y, 2, 1000, &ss );
+    snprintf( buf, 80, "  alpha-beta: %lu nodes/s, depth %u",
+              (unsigned long)(ss.nodes * 1000ull / (ss.ms ? ss.ms : 1)), (unsigned)ss.depth );
+    serial_write_line( buf );
+    tictac_mcts( &b, &x, &y, 2, 1000, &ms );
+    snprintf( buf, 80, "  mcts: %lu playouts/s, %lu tree nodes",
+              (unsigned long)(ms.playouts * 1000ull / (ms.ms ? ms.ms : 1)), (unsigned long)ms.nodes );
+    serial_write_line( buf );
+
+    xSemaphoreGive( (SemaphoreHandle_t)arg );
+    vTaskDelete( NULL );
+}
+
+int game_engine_bench( void )
+{
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+
+    if ( !done )
+        return -1;
+    serial_write_line( "Engine benchmark:" );
+    if ( xTaskCreate( engine_bench, "enginebench", 8192, done, PRIORITY_GAME, NULL ) == pdPASS )
+        xSemaphoreTake( done, portMAX_DELAY );
+    vSemaphoreDelete( done );
+    return 0;
+}
+
 void game_init( void )
 {
     game_turn = xSemaphoreCreateBinary( );
+    tictac_book_init( );
 
     xTaskCreate(
         my_policy,
         "game_policy",
-        4092,
+        8192,       // the search recurses
         NULL,
         PRIORITY_GAME,
         0 );
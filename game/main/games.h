@@ -19,6 +19,12 @@
 /*  Action packets     */
 #define GAME_PACKET_QUIT      0x06  // Player informs about quiting
 #define GAME_PACKET_ACTION    0x07  // Player's action
+/*  Other packets      */
+#define GAME_PACKET_LEADERS   0x08  // Leaderboard request and response
+#define GAME_PACKET_DELTA     0x09  // Game status as the last moves
+#define GAME_PACKET_RESYNC    0x0a  // Node asks for the full status
+#define GAME_PACKET_WATCH     0x0b  // Node wants to follow a game
+#define GAME_PACKET_TOURNEY   0x0c  // Register to the tournament, answered as REGISTER
 
 
 /*
@@ -32,12 +38,17 @@
  *  Games we support
  */
 #define GAME_TICTACTOE        0x01
+#define GAME_CONNECT4         0x02  // server only, see connect4.h
 
 /*
  *  Other constants
  */
 #define GAME_STATUS_HEADER      12  // type, game, seq, round, node, res
 #define GAME_STATE            ((LOWNET_PAYLOAD_SIZE)-(GAME_STATUS_HEADER))
+#define GAME_LEADERS            10  // top players in a leaderboard packet
+#define GAME_DELTA_MOVES         2  // moves in a delta status
+#define GAME_SNAPSHOT_ROUNDS    16  // full status at least this often
+#define GAME_BROADCAST        0xFF  // status goes out once, to everybody
 
 /******************************************************************************/
 
@@ -58,6 +69,7 @@ typedef struct __attribute__((__packed__))
     /*** server response uses the following ***/
     uint8_t       flags;    // server: ACK or NACK; node: zero
     uint8_t       online;   // how many players online
+    uint8_t       queued;   // how many of them wait for a game
 } game_register_t;
 
 /******************************************************************************/
@@ -81,6 +93,36 @@ typedef struct __attribute__((__packed__))
 
 /******************************************************************************/
 
+/*
+ *  Delta status: the moves of rounds round-moves .. round-1, oldest
+ *  first, and the digest of the board after them (tictac_digest).
+ *  On a digest mismatch the node sends GAME_PACKET_RESYNC, as a
+ *  game_action_t, and gets a full status back.
+ *
+ *  Status and delta packets are broadcast once per move, players and
+ *  spectators pick them by seq.  GAME_PACKET_WATCH (a game_action_t
+ *  with seq) subscribes: the server answers with the full status and
+ *  the node follows the broadcasts from then on.
+ */
+typedef struct __attribute__((__packed__))
+{
+    /*** the common part ***/
+    uint8_t       type;     // what kind of packet        (1)
+    uint8_t       game;     // what game is this          (1)
+    /*** game idenfiers ***/
+    uint32_t      seq;      // game id number             (4)
+    uint32_t      round;    // game round                 (4)
+    /*** status ***/
+    uint8_t       node_1;   // player #1                  (1)
+    uint8_t       node_2;   // player #2                  (1)
+    uint8_t       moves;    // valid moves below          (1)
+    uint8_t       move_x[GAME_DELTA_MOVES];
+    uint8_t       move_y[GAME_DELTA_MOVES];
+    uint32_t      digest;   // board after the moves      (4)
+} game_delta_t;
+
+/******************************************************************************/
+
 /*
  *  Game actions messages
  */
@@ -102,7 +144,32 @@ typedef struct __attribute__((__packed__))
 
 /******************************************************************************/
 
+/*
+ *  Leaderboard, best first.  Node sends just the header.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint8_t       node;     // player                     (1)
+    uint16_t      rating;   // Elo rating                 (2)
+    uint16_t      games;    // games rated                (2)
+} game_leader_t;
+
+typedef struct __attribute__((__packed__))
+{
+    /*** the common part ***/
+    uint8_t       type;     // what kind of packet        (1)
+    uint8_t       game;     // what game is this          (1)
+    /*** server response ***/
+    uint8_t       count;    // valid entries              (1)
+    game_leader_t leader[GAME_LEADERS];
+} game_leaders_t;
+
+/******************************************************************************/
+
 void game_register( uint8_t snode );                // register to game server
+void game_tourney( uint8_t snode );                 // ..or to its tournament
+void game_leaders( uint8_t snode );                 // ask for the leaderboard
+void game_watch( uint8_t snode, uint32_t seq );     // follow game seq, 0 to stop
 void game_receive( const lownet_frame_t *frame );   // handle the incoming packets here
 void game_init( void );
 
@@ -115,7 +182,15 @@ void tictac_display_board( const tictactoe_t *ttt );
  *  These are implemented in tictac_node.c
  */
 uint32_t tictac_checksum( const tictactoe_t *b );
+uint32_t tictac_checksum_empty( void );
+uint32_t tictac_checksum_move( uint32_t crc, int i, int j, uint8_t s );  // after s takes empty (i,j)
 int      tictac_move(     const tictactoe_t *b,
                           int *xp, int *yp,
-                          uint8_t s, uint32_t time_ms );
+                          uint8_t s, uint32_t time_ms );   // the book, else the engine
+
+#define TICTAC_POLICY_AB    0   // alpha-beta, tictac_search.c
+#define TICTAC_POLICY_MCTS  1   // Monte Carlo, tictac_mcts.c
+
+int      tictac_policy( int e );    // engine of tictac_move(), -1 just to ask
+int      game_engine_bench( void ); // a second of each to serial
 #endif
@@ -1,5 +1,7 @@
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <freertos/FreeRTOS.h>
@@ -11,19 +13,27 @@
 #include "esp_timer.h"
 
 #include "games.h"
-#include "tictactoe.h"
+#include "gameengine.h"
+#include "gamestore.h"
+#include "timerwheel.h"
+#include "lobby.h"
+#include "rating.h"
+#include "journal.h"
+#include "tourney.h"
 #include "gameserver.h"
 #include "app_chat.h"
+#include "serial_io.h"
 
 #define TAG "gameserver.c"
 
 /*
- *  Single tasks runs these so no locking mechanisms needed!
+ *  Games are sharded by seq over GAME_SHARDS worker tasks, one per
+ *  core.  A shard owns its game table, timer wheel and queues, so the
+ *  move path needs no locks.  The home shard also runs the lobby, the
+ *  ratings and the announcements; registrations reach it through a
+ *  single-producer ring from the lownet task.
  */
 
-#define MAX_GAMES        32
-#define MAX_STATE      1024
-
 #define FIVE_SECONDS   6000   // little grace period ... but not guaranteed :)
 #define TEN_SECONDS   10000
 
@@ -35,21 +45,11 @@
 
 #define PRIORITY_GAMESERVER 2  // wohoo, we are important!
 
-/*
- *  Internal data structure - one per ongoing game
- */
-typedef struct
-{
-    uint64_t  last_move;  // internal clock of our ESP32
-    uint8_t   state;      // 1=one won, 2=two won, 3=on going
-    uint8_t   game;       // what game is this
-    uint16_t  seq;        // game id number
-    uint16_t  round;      // current round
-    uint8_t   turn;       // whose turn, 1 or 2; or 0 if game over
-    uint8_t   node_1;
-    uint8_t   node_2;
-    char      board[MAX_STATE];
-} game_t;
+#define GAME_SHARDS       portNUM_PROCESSORS
+#define HOME              0    // shard with the lobby, ratings and announcements
+#define REG_RING          32   // registration handoff, power of two
+
+#define SELF_PLAY           0  // debug: a registering node plays against itself
 
 #define ANNOUNCEMENT_LEN  80
 
@@ -57,19 +57,65 @@ typedef struct {
     char msg[ ANNOUNCEMENT_LEN ];
 } announcement_t;
 
+typedef struct {
+    uint32_t  seq;
+    uint8_t   game;
+    uint8_t   node_1;
+    uint8_t   node_2;
+} game_start_t;     // home -> shard
+
+#define NOT_PLAYED  2
+
+typedef struct {
+    uint8_t   winner;
+    uint8_t   loser;
+    uint8_t   tie;      // 1 tie, NOT_PLAYED if the game could not start
+} game_result_t;    // shard -> home
+
+typedef struct {
+    uint8_t   node;
+    uint8_t   game;
+    uint8_t   type;     // GAME_PACKET_REGISTER or _TOURNEY
+} reg_entry_t;      // lownet -> home
+
+typedef struct {
+    uint8_t   mode;     // TOURNEY_RR or _SWISS; 0 = begin
+    uint8_t   rounds;
+} tourney_ctl_t;    // serial -> home
+
+typedef struct
+{
+    int               id;
+    gamestore_t       store;    // game_t's of this shard, see gamestore.h
+    timerwheel_t      wheel;    // ..and their deadlines
+    uint8_t           work[ GAME_WORK_SIZE ] __attribute__((aligned(4)));  // engine scratch
+    QueueHandle_t     actions;  // game_action_t from lownet
+    QueueHandle_t     starts;   // game_start_t from home
+    SemaphoreHandle_t rearm;    // new work outside the queues, recompute our sleep
+    QueueSetHandle_t  ready;    // the above three, on home also msg_queue and results
+    volatile int      active;   // running games
+} shard_t;
+
 
 /********************************************************************************/
 
-static QueueHandle_t      game_queue;
-static QueueHandle_t      msg_queue;
-static SemaphoreHandle_t  gamelukko;
-static uint8_t            waiting_node = 0;
+static shard_t          shards[ GAME_SHARDS ];
+
+/*  home shard only  */
+static QueueHandle_t    msg_queue;
+static QueueHandle_t    results;      // game_result_t from all shards
+static lobby_t          lobby[ GAME_ENGINES ];  // players waiting, per game
+static int              lobby_count = 0;        // ..in all, for any shard to read
+static tourney_t        tourney;
+static QueueHandle_t    tourney_ctl;  // tourney_ctl_t
+static uint32_t         next_game_seq = 1;
 
-static uint32_t      next_game_seq = 1;
-static game_t        games[ MAX_GAMES ];  // init to all zero
+/*  registration ring: the lownet task writes head, home writes tail  */
+static reg_entry_t      reg_ring[ REG_RING ];
+static uint32_t         reg_head = 0;
+static uint32_t         reg_tail = 0;
 
-static int           gameserver_ok = 0;
-static int           active_games  = 0;
+static int              gameserver_ok = 0;
 
 /********************************************************************************/
 /*
@@ -106,27 +152,56 @@ uint64_t game_time(void) {
     return esp_timer_get_time() / 1000; // in ms
 }
 
+shard_t *shard_of( uint32_t seq )
+{
+    return &shards[ seq % GAME_SHARDS ];
+}
 
-game_t * find_game( uint32_t seq )
+int active_games( void )
 {
-    for( int i=0; i<MAX_GAMES; i++)
-    {
-        if ( games[i].seq == seq && games[i].state != STATE_FREE )
-            return &games[i];
-    }
-    return 0;
+    int n = 0;
+    for( int i=0; i<GAME_SHARDS; i++ )
+        n += shards[i].active;
+    return n;
+}
+
+game_t * find_game( shard_t *sh, uint32_t seq )
+{
+    game_t *g = gamestore_find( &sh->store, seq );
+    return g && g->state != STATE_FREE ? g : 0;
 }
 
+/*
+ *  (Re)arm the game deadline, after_ms from the last move
+ */
+void game_arm( shard_t *sh, game_t *g, uint32_t after_ms )
+{
+    tw_arm( &sh->wheel, &g->timer, g->last_move + after_ms );
+}
 
 /*
- *  Inform both parties
+ *  Make the move of player s and check the outcome.  Returns -1 if the
+ *  move is illegal, else GAME_OUTCOME_xyz; (*x,*y) is the square taken.
  */
-int send_status( game_t *g )
+int game_apply_move( shard_t *sh, game_t *g, int *x, int *y, uint8_t s )
 {
+    const game_engine_t *e = game_engine( g->game );
+
+    if ( !e || e->move( g->data, x, y, s ) )
+        return -1;
+    return e->outcome( g->data, sh->work );
+}
+
+
+/*
+ *  Full status with the whole board, to one node or broadcast (node 0)
+ */
+int send_full( shard_t *sh, game_t *g, uint8_t node )
+{
+    const game_engine_t *e = game_engine( g->game );
     lownet_frame_t pkt;
     pkt.source      = lownet_get_device_id();
     pkt.protocol    = LOWNET_PROTOCOL_GAME;
-    pkt.length      = LOWNET_PAYLOAD_SIZE;  // the payload length is game specific... push it all!
     game_status_t *gs = (game_status_t *)pkt.payload;
 
     switch( g->state )
@@ -142,62 +217,259 @@ int send_status( game_t *g )
     gs->round  = g->round;
     gs->node_1 = g->node_1;
     gs->node_2 = g->node_2;
-    //for(int i=0; i<GAME_STATE; i++)
-    //    gs->state[GAME_STATUS_HEADER+i] = 0;
-    tictac_encode(  (const tictactoe_t *)&g->board, (tictactoe_payload_t *)(pkt.payload+sizeof(game_status_t)) );
+    pkt.length = sizeof(game_status_t) + e->encode( g->data, sh->work, pkt.payload+sizeof(game_status_t) );
 
-    pkt.destination = g->node_1;
+    pkt.destination = node ? node : GAME_BROADCAST;
     lownet_send( &pkt );
-    
-    if ( g->node_1 != g->node_2 )  // autoplay mode
+    return 0;
+}
+
+/*
+ *  Delta status: the last moves and the board digest
+ */
+int send_delta( game_t *g )
+{
+    lownet_frame_t pkt;
+    game_delta_t  *gd = (game_delta_t *)pkt.payload;
+
+    pkt.source      = lownet_get_device_id();
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = sizeof(game_delta_t);
+
+    gd->type   = GAME_PACKET_DELTA;
+    gd->game   = g->game;
+    gd->seq    = g->seq;
+    gd->round  = g->round;
+    gd->node_1 = g->node_1;
+    gd->node_2 = g->node_2;
+    gd->moves  = g->round > GAME_DELTA_MOVES ? GAME_DELTA_MOVES : g->round - 1;
+    game_engine( g->game )->delta( g->data, gd );
+
+    pkt.destination = GAME_BROADCAST;
+    lownet_send( &pkt );
+    return 0;
+}
+
+/*
+ *  Inform players and spectators with one broadcast: a delta while the
+ *  game runs, the whole board at the start, every GAME_SNAPSHOT_ROUNDS
+ *  and at the end
+ */
+int send_status( shard_t *sh, game_t *g )
+{
+    if ( g->state == STATE_RUNNING && g->round > 1 &&
+         (g->round - 1) % GAME_SNAPSHOT_ROUNDS )
+        return send_delta( g );
+    return send_full( sh, g, 0 );
+}
+
+/*
+ *  Home, after the lobby changed: the count the other shards see
+ */
+void lobby_counted( void )
+{
+    int n = 0;
+    for( int i=0; i<GAME_ENGINES; i++ )
+        n += lobby[i].n;
+    __atomic_store_n( &lobby_count, n, __ATOMIC_RELAXED );
+}
+
+int lobby_waiting( void )
+{
+    return __atomic_load_n( &lobby_count, __ATOMIC_RELAXED );
+}
+
+/*
+ *  Answer a registration; online = players in games or waiting
+ */
+void register_respond( uint8_t node, uint8_t game, uint8_t flag )
+{
+    lownet_frame_t pkt;
+    game_register_t *reg = (game_register_t *)pkt.payload;
+    int waiting = lobby_waiting();
+    int online  = 2*active_games() + waiting;
+
+    pkt.source      = lownet_get_device_id();
+    pkt.destination = node;
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = sizeof(game_register_t);
+        
+    reg->type   = GAME_PACKET_REGISTER;
+    reg->game   = game;
+    reg->flags  = flag;
+    reg->online = online < 255 ? online : 255;
+    reg->queued = waiting < 255 ? waiting : 255;
+    lownet_send( &pkt );
+    ESP_LOGW(TAG, "reg response %d to node %02x", (unsigned int)flag, (unsigned int)node );
+}
+
+/*
+ *  Home: hand the pairs to their shards, round robin by seq.
+ *  Pairs that do not fit are told so.  Returns the games handed out.
+ */
+int start_newgames( uint8_t game, const lobby_pair_t *pairs, int n )
+{
+    int k = 0;
+
+    for( int i=0; i<n; i++ )
     {
-        pkt.destination = g->node_2;
-        lownet_send( &pkt );
+        game_start_t st = { next_game_seq, game, pairs[i].node_1, pairs[i].node_2 };
+        shard_t     *sh = shard_of( st.seq );
+
+        if ( xQueueSend( sh->starts, &st, 0 ) == pdTRUE )
+        {
+            next_game_seq++;
+            k++;
+            continue;
+        }
+        register_respond( st.node_1, game, GAME_NACK );  // too many games?!
+        register_respond( st.node_2, game, GAME_NACK );
+        tourney_result( &tourney, st.node_1, st.node_2, -1 );
+        ESP_LOGW(TAG, "Game between %02x and %02x cancelled",
+                 (unsigned int)st.node_1, (unsigned int)st.node_2 );
     }
-    return 0;
+    return k;
 }
 
-game_t *start_newgame( uint8_t game, uint8_t node_1, uint8_t node_2 )
+int start_newgame( uint8_t game, uint8_t node_1, uint8_t node_2 )
 {
-    if ( !gameserver_ok )
-        return 0;
+    lobby_pair_t p = { node_1, node_2 };
+    return start_newgames( game, &p, 1 );
+}
 
-    if ( xSemaphoreTake( gamelukko, 1000 / portTICK_PERIOD_MS ) != pdTRUE )
-        return 0;
-    
-    for(int i=0; i<MAX_GAMES; i++)
+/*
+ *  Shard: set up a game handed over by home
+ */
+void game_start( shard_t *sh, const game_start_t *st )
+{
+    game_t *g = gamestore_alloc( &sh->store, st->seq );
+    char    buf[80];
+
+    if ( !g )
     {
-        game_t *g = games + i;
-        
-        if ( g->state == STATE_FREE )
+        game_result_t r = { st->node_1, st->node_2, NOT_PLAYED };
+        register_respond( st->node_1, st->game, GAME_NACK );  // too many games?!
+        register_respond( st->node_2, st->game, GAME_NACK );
+        xQueueSend( results, &r, 0 );
+        return;
+    }
+    g->last_move = game_time();
+    g->state     = STATE_RUNNING;
+    g->game      = st->game;
+    g->round     = 1;       // player 1 starts!
+    g->turn      = st->node_1;
+    g->node_1    = st->node_1;
+    g->node_2    = st->node_2;
+    game_engine( g->game )->init( g->data );
+    game_arm( sh, g, FIVE_SECONDS );
+    sh->active++;
+    journal_start( g->seq, g->game, g->node_1, g->node_2 );
+
+    sprintf( buf, "Game %lu between 0x%02x and 0x%02x has started!",
+             (unsigned long)g->seq, (unsigned int)g->node_1, (unsigned int)g->node_2 );
+    announce( buf );
+    send_status( sh, g );
+}
+
+int game_room( void )
+{
+    int room = 0;
+    for( int i=0; i<GAME_SHARDS; i++ )
+        room += shards[i].store.capacity - shards[i].store.used;  // a hint, shards NACK the rest
+    return room;
+}
+
+/*
+ *  Home: pairing rounds of the lobbies that are due, as many games as
+ *  we have room for.  Returns when the next round is due, 0 if none.
+ */
+uint64_t game_matchmake( uint64_t tnow )
+{
+    lobby_pair_t pairs[ LOBBY_MAX/2 ];
+    uint64_t     next = 0;
+    int          n;
+
+    for( int i=0; i<GAME_ENGINES; i++ )
+    {
+        lobby_t *L = &lobby[i];
+
+        if ( L->round && L->round <= tnow )
         {
-            g->last_move = game_time();
-            g->state     = STATE_RUNNING;
-            g->game      = game;
-            g->seq       = next_game_seq++;
-            g->round     = 1;       // player 1 starts!
-            g->turn      = node_1;
-            g->node_1    = node_1;
-            g->node_2    = node_2;
-            memset( g->board, 0, MAX_STATE );
-            active_games++;
-            xSemaphoreGive( gamelukko );
-            {
-                char buf[80];
-                sprintf( buf, "Game %lu between 0x%02x and 0x%02x has started!",
-                         (unsigned long)g->seq, (unsigned int)node_1, (unsigned int)node_2 );
-                announce( buf );
-            }
-            send_status( g );
-            return g;
+            n = lobby_pair( L, tnow, pairs, game_room() );
+            lobby_counted();
+            if ( n )
+                start_newgames( game_engines[i]->game, pairs, n );
         }
+        if ( L->round && (!next || L->round < next) )
+            next = L->round;
     }
-    xSemaphoreGive( gamelukko );
-    return 0;
+    return next;
+}
+
+
+/*
+ *  Home: start the tournament games that can start, before the lobby
+ *  gets the room.  Returns when to try again, 0 if no tournament.
+ */
+uint64_t tourney_schedule( uint64_t tnow )
+{
+    lobby_pair_t pairs[ TOURNEY_PLAYERS/2 ];
+    int          room = game_room();
+    int          n;
+
+    if ( tourney.state != TOURNEY_RUNNING )
+        return 0;
+    n = tourney_next( &tourney, pairs, room < TOURNEY_PLAYERS/2 ? room : TOURNEY_PLAYERS/2 );
+    if ( n )
+        start_newgames( GAME_TICTACTOE, pairs, n );
+    return tnow + 1000;   // slots free up without telling us
 }
 
+/*
+ *  Home: a game is over
+ */
+void game_result( const game_result_t *gr )
+{
+    char buf[ ANNOUNCEMENT_LEN ];
+    int  r, pos;
+
+    if ( gr->tie != NOT_PLAYED )
+        rating_result( gr->winner, gr->loser, gr->tie );
+    r = tourney_result( &tourney, gr->winner, gr->loser,
+                        gr->tie == NOT_PLAYED ? -1 : gr->tie ? 0 : 1 );
+    if ( r < 1 )
+        return;
+    pos = r == 2 ? sprintf( buf, "Tournament over: " )
+                 : sprintf( buf, "Tournament round %d: ", (int)tourney.round );
+    tourney_summary( &tourney, buf + pos, sizeof(buf) - pos );
+    announce( buf );
+}
+
+/*
+ *  Home: tournament commands from the serial line
+ */
+void tourney_control( const tourney_ctl_t *c )
+{
+    char buf[ ANNOUNCEMENT_LEN ];
+
+    if ( c->mode )
+    {
+        if ( tourney_open( &tourney, c->mode, c->rounds ) )
+            return;
+        sprintf( buf, "%s tournament open, register with type 0x%02x",
+                 c->mode == TOURNEY_RR ? "Round-robin" : "Swiss", GAME_PACKET_TOURNEY );
+    }
+    else
+    {
+        if ( tourney_begin( &tourney ) )
+            return;
+        sprintf( buf, "Tournament of %d players, %d games each, begins!",
+                 tourney.n, (int)tourney.rounds );
+    }
+    announce( buf );
+}
 
-void announce_winner( game_t *g ) 
+void announce_winner( shard_t *sh, game_t *g ) 
 {
     uint8_t n1,n2;
     switch ( g->state ) 
@@ -228,175 +500,263 @@ void announce_winner( game_t *g )
                      (unsigned long)g->seq, (unsigned int)n1, (unsigned int)n2 );
         announce( buf );
     }
+    {
+        game_result_t r = { n1, n2, g->state==STATE_TIE };
+        if ( xQueueSend( results, &r, 0 ) != pdTRUE )
+            ESP_LOGW(TAG, "Game %lu: result not rated", (unsigned long)g->seq );
+    }
     /*  Inform players  */
-    send_status( g );
+    send_status( sh, g );
 }
 
 
+/*
+ *  Game over by a move, a quit or a timeout: announce the result and
+ *  keep the slot for a while so that late packets find the result
+ */
+void game_finished( shard_t *sh, game_t *g, uint8_t state )
+{
+    g->state     = state;
+    g->last_move = game_time();
+    game_arm( sh, g, TEN_SECONDS );
+    sh->active--;
+    journal_result( g->seq, state );
+    announce_winner( sh, g );
+}
+
 /********************************************************************************/
 
 
-void process_game_action( game_t *g, game_action_t *ga ) 
+void process_game_action( shard_t *sh, game_t *g, game_action_t *ga ) 
 {    
-    switch ( g->game )
-    {
-        case GAME_TICTACTOE:
-            lownet_frame_t pkt;
-            uint8_t x = ga->move_x;
-            uint8_t y = ga->move_y;
-            uint8_t s = 2 - (g->round & 1);
+    const game_engine_t *e = game_engine( g->game );
+    lownet_frame_t pkt;
+    int     x = ga->move_x;
+    int     y = ga->move_y;
+    uint8_t s = 2 - (g->round & 1);
             
-            if ( ( s==1 && ga->node != g->node_1 ) ||
-                 ( s==2 && ga->node != g->node_2 ) )
-            {
-                ESP_LOGE(TAG, "action from %02x when it's not its turn!", (unsigned)ga->node );
-                s = 0;
-            }
-
-            tictactoe_t *b = (tictactoe_t *)g->board;
+    if ( ( s==1 && ga->node != g->node_1 ) ||
+         ( s==2 && ga->node != g->node_2 ) )
+    {
+        ESP_LOGE(TAG, "action from %02x when it's not its turn!", (unsigned)ga->node );
+        s = 0;
+    }
 
-            //ESP_LOGI(TAG, "action from %02x: (%d,%d) with %d", (unsigned)ga->node, (int)x, (int)y, (int)s );
-            
-            /* prepare the response */
-            pkt.source      = lownet_get_device_id();
-            pkt.destination = ga->node;
-            pkt.protocol    = LOWNET_PROTOCOL_GAME;
-            pkt.length      = sizeof(game_action_t );
-            game_action_t *ga2 = (game_action_t *)pkt.payload;
-            *ga2 = *ga;
+    //ESP_LOGI(TAG, "action from %02x: (%d,%d) with %d", (unsigned)ga->node, (int)x, (int)y, (int)s );
             
-            if ( x >= TICTACTOE_BOARD ||
-                 y >= TICTACTOE_BOARD ||
-                 !s || s>2 ||
-                 tictac_set(b,x,y,s) )    // failure -- square already marked?
-            {
-                ga2->flags = GAME_NACK;
-                lownet_send( &pkt );
-            }
-            else
-            {
-                ga2->flags = GAME_ACK;
-                lownet_send( &pkt );
-
-                g->round++;
-                g->turn = (g->round & 1) ? g->node_1 : g->node_2;
-                g->last_move = game_time();
-
-                //tictac_display_board( (tictactoe_t *)g->board );  // debug
-                
-                /* check the game outcome -- inform the opponent */
-                int st = tictac_game_over( b );
-                if ( st )
-                {
-                    while ( xSemaphoreTake( gamelukko, 1000 / portTICK_PERIOD_MS ) != pdTRUE )
-                        printf( "gamelukko problems...\n" );
-                    g->state = st==1 ? STATE_ONE_WON : STATE_TWO_WON;
-                    active_games--;
-                    xSemaphoreGive( gamelukko );
-                    announce_winner( g );
-                }
-                else
-                    send_status( g );  /*  Just inform players  */
-            }
-            break;
+    /* prepare the response */
+    pkt.source      = lownet_get_device_id();
+    pkt.destination = ga->node;
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = sizeof(game_action_t );
+    game_action_t *ga2 = (game_action_t *)pkt.payload;
+    *ga2 = *ga;
+
+    /* boards apart: refuse the move and send ours */
+    if ( s && e->verify && e->verify( g->data, x, y, s, ga->checksum ) )
+    {
+        ESP_LOGW(TAG, "checksum mismatch from %02x in game %lu, resync",
+                 (unsigned)ga->node, (unsigned long)g->seq );
+        ga2->flags = GAME_NACK;
+        lownet_send( &pkt );
+        send_full( sh, g, ga->node );
+        return;
+    }
             
-        default:
-            ESP_LOGW(TAG, "action for unknown game type" );
-            return;
+    int st = game_apply_move( sh, g, &x, &y, s );
+    if ( st < 0 )
+    {
+        ga2->flags = GAME_NACK;
+        lownet_send( &pkt );
+        return;
+    }
+    ga2->flags = GAME_ACK;
+    lownet_send( &pkt );
+
+    journal_move( g->seq, g->game, g->round, x, y );   // the square taken
+    g->round++;
+    g->turn = (g->round & 1) ? g->node_1 : g->node_2;
+    g->last_move = game_time();
+
+    /* check the game outcome -- inform the opponent */
+    if ( st )
+        game_finished( sh, g, st==GAME_OUTCOME_ONE ? STATE_ONE_WON :
+                              st==GAME_OUTCOME_TWO ? STATE_TWO_WON : STATE_TIE );
+    else
+    {
+        game_arm( sh, g, FIVE_SECONDS );
+        send_status( sh, g );  /*  Just inform players  */
     }
 }
 
 /*
- * "Elo formula":
- *
- *  r' = r + k*(s-e)
- *
- *  k = "learning rate", 32
- *  s = outcome, (win=1, loss=0, tie=1/2)
- *  e = expected outcome = qa/(qa+qb), qi=10^(ri/c)
- *      where c=400
- *  r_init = 1500
- *  r_min  = 1000
+ *  One action from the queue
+ */
+void game_handle_action( shard_t *sh, const game_action_t *ga )
+{
+    game_t *g = find_game( sh, ga->seq );
+    int     plr;
+
+    if ( ga->type == GAME_PACKET_RESYNC || ga->type == GAME_PACKET_WATCH )
+    {
+        /* the board is broadcast anyway, anyone may have it */
+        if ( g )
+            send_full( sh, g, ga->node );
+        return;
+    }
+    if ( !g || g->round != ga->round || g->game != ga->game ||
+         g->state != STATE_RUNNING )
+    {
+        ESP_LOGW(TAG, "action by %02x for non-existing game (seq %lu)",
+                 (unsigned int)ga->node, (unsigned long)ga->seq );
+        return;
+    }
+    if      ( ga->node == g->node_1 )  plr = 1;
+    else if ( ga->node == g->node_2 )  plr = 2;
+    else
+    {
+        ESP_LOGW( TAG, "game_loop: illegal move, ignored (2)" );
+        return;
+    }
+    if ( ga->node != g->turn )
+    {
+        ESP_LOGW(TAG, "not node's turn" );
+        return;
+    }            
+
+    /* we may have a valid action */
+    if ( ga->type == GAME_PACKET_QUIT )
+    {
+        ESP_LOGW(TAG, "quit packet received -- untested feature!" );
+        game_finished( sh, g, plr==1 ? STATE_TWO_WON : STATE_ONE_WON );
+    }
+    else if ( ga->type == GAME_PACKET_ACTION )
+    {
+        game_action_t copy = *ga;
+        process_game_action( sh, g, &copy );
+    }
+}
+
+/*
+ *  Janitor duties: only the games whose deadline has passed
  */
+void game_timeouts( shard_t *sh, uint64_t tnow )
+{
+    tw_node_t *n = tw_expire( &sh->wheel, tnow );
+
+    while ( n )
+    {
+        game_t *g = (game_t *)((char *)n - offsetof(game_t, timer));
+        n = n->next;  // before re-arming reuses the links
+        
+        if ( g->state==STATE_RUNNING )
+        {
+            /* the one whose turn it was loses */
+            game_finished( sh, g, g->turn==g->node_1 ? STATE_TWO_WON : STATE_ONE_WON );
+        }
+        else  /* game was finished earlier */
+            gamestore_release( &sh->store, g );  // state is STATE_FREE again
+    }
+}
+
+void register_node( uint8_t node, uint8_t game );
 
 /*
- *  This is a manager and a janitor!
+ *  Home: registrations handed over by the lownet task
+ */
+void reg_drain( void )
+{
+    uint32_t head = __atomic_load_n( &reg_head, __ATOMIC_ACQUIRE );
+
+    while ( reg_tail != head )
+    {
+        reg_entry_t e = reg_ring[ reg_tail & (REG_RING-1) ];
+        __atomic_store_n( &reg_tail, reg_tail + 1, __ATOMIC_RELEASE );
+        if ( e.type == GAME_PACKET_TOURNEY )
+        {
+            int r = tourney_join( &tourney, e.node );
+            register_respond( e.node, e.game, r < 0 ? GAME_NACK : GAME_ACK );
+        }
+        else
+            register_node( e.node, e.game );
+    }
+}
+
+/*
+ *  This is a manager and a janitor!  One per shard.
+ *
+ *  Sleeps until the next game deadline, action or game to start;
+ *  home also for a pairing round, tournament games, rating or journal
+ *  save, result, registration or announcement, whichever comes first.
  */
 void gameserver_loop( void *p )
 {
+    shard_t *sh   = (shard_t *)p;
+    int      home = sh->id == HOME;
+
     while( 1 )
     {
         game_action_t ga;
-        int      twait = 500 / portTICK_PERIOD_MS;
-        uint64_t tnow  = game_time();
+        game_start_t  st;
+        game_result_t gr;
+        tourney_ctl_t tc;
+        uint64_t      tnow = game_time();
+        uint64_t      next, pair = 0, flush = 0, jflush = 0, retry = 0;
+        TickType_t    twait;
+
+        game_timeouts( sh, tnow );
+        if ( home )
+        {
+            reg_drain();
+            retry  = tourney_schedule( tnow );
+            pair   = game_matchmake( tnow );
+            flush  = rating_flush( tnow, 0 );
+            jflush = journal_flush( tnow, 0 );
+        }
+
+        next = tw_next( &sh->wheel );
+        if ( pair && pair < next )
+            next = pair;
+        if ( flush && flush < next )
+            next = flush;
+        if ( jflush && jflush < next )
+            next = jflush;
+        if ( retry && retry < next )
+            next = retry;
+
+        if ( next == TW_NEVER )
+            twait = portMAX_DELAY;
+        else if ( next <= tnow )
+            twait = 0;
+        else
+            twait = (next - tnow + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
 
-        one_announcement();
+        QueueSetMemberHandle_t ready = xQueueSelectFromSet( sh->ready, twait );
         
-        while ( xQueueReceive( game_queue, &ga, twait ) == pdTRUE )
+        if ( ready == sh->actions )
         {
-            game_t *g = find_game( ga.seq );
-            int     plr;
-            
-            twait = 0;  // let's not prolong this
-            if ( !g || g->round != ga.round || g->game != ga.game ||
-                 g->state != STATE_RUNNING )
-            {
-                ESP_LOGW(TAG, "action by %02x for non-existing game (seq %lu)",
-                         (unsigned int)ga.node, (unsigned long)ga.seq );
-                continue;
-            }
-            if      ( ga.node == g->node_1 )  plr = 1;
-            else if ( ga.node == g->node_2 )  plr = 2;
-            else
-            {
-                ESP_LOGW( TAG, "game_loop: illegal move, ignored (2)" );
-                continue;
-            }
-            if ( ga.node != g->turn )
-            {
-                ESP_LOGW(TAG, "not node's turn" );
-                continue;
-            }            
-
-            /* we may have a valid action */
-            if ( ga.type == GAME_PACKET_QUIT )
-            {
-                ESP_LOGW(TAG, "quit packet received -- untested feature!" );
-                if ( xSemaphoreTake( gamelukko, portMAX_DELAY ) != pdTRUE )
-                    printf( "oops" );
-                g->state = plr==1 ? STATE_TWO_WON : STATE_ONE_WON;
-                active_games--;
-                xSemaphoreGive( gamelukko );
-                announce_winner( g );
-            }
-            else if ( ga.type == GAME_PACKET_ACTION )
-            {
-                process_game_action( g, &ga );
-            }
+            if ( xQueueReceive( sh->actions, &ga, 0 ) == pdTRUE )
+                game_handle_action( sh, &ga );
         }
-        
-        // Janitor duties
-        tnow = game_time();
-        for( int i=0; i<MAX_GAMES; i++ ) 
+        else if ( ready == sh->starts )
+        {
+            if ( xQueueReceive( sh->starts, &st, 0 ) == pdTRUE )
+                game_start( sh, &st );
+        }
+        else if ( ready == sh->rearm )
+            xSemaphoreTake( sh->rearm, 0 );
+        else if ( ready == results )
+        {
+            if ( xQueueReceive( results, &gr, 0 ) == pdTRUE )
+                game_result( &gr );
+        }
+        else if ( ready == tourney_ctl )
         {
-            game_t *g = games + i;
-            if ( g->state==STATE_FREE )
-                continue;
-            if ( g->state==STATE_RUNNING )
-            {
-                if ( g->last_move + FIVE_SECONDS < tnow )
-                {
-                    g->state = g->turn==g->node_1 ? STATE_TWO_WON : STATE_ONE_WON;
-                    g->last_move = tnow;
-                    announce_winner( g );
-                }
-            }
-            else  /* game was finished earlier */
-            {
-                if ( g->last_move + TEN_SECONDS < tnow )
-                    g->state = STATE_FREE;    
-            }
+            if ( xQueueReceive( tourney_ctl, &tc, 0 ) == pdTRUE )
+                tourney_control( &tc );
         }
+        else if ( ready == msg_queue )
+            one_announcement();
     }
 }
 
@@ -411,142 +771,463 @@ void game_action( const lownet_frame_t *frame )
 		ESP_LOGW(TAG, "action by %02x for node %02x", (unsigned int)node, (unsigned int)ga->node );
         return;
     }
-    if ( xQueueSend( game_queue, ga, 0 ) != pdTRUE )
+    if ( xQueueSend( shard_of( ga->seq )->actions, ga, 0 ) != pdTRUE )
 		ESP_LOGE(TAG, "game queue full!" );
 }
 
 
-void register_node( const lownet_frame_t *frame )
+/*
+ *  Lownet task: hand the registration to home, never blocks
+ */
+void register_handoff( const lownet_frame_t *frame )
 {
-    uint8_t node = frame->source;
     const game_register_t *gr = (const game_register_t *)frame->payload;
+    uint32_t head = reg_head;   // only we write it
 
-    void respond( uint8_t n, uint8_t flag )
+    if ( head - __atomic_load_n( &reg_tail, __ATOMIC_ACQUIRE ) >= REG_RING )
     {
-        lownet_frame_t pkt;
-        game_register_t *reg = (game_register_t *)pkt.payload;
-        pkt.source      = lownet_get_device_id();
-        pkt.destination = n;
-        pkt.protocol    = LOWNET_PROTOCOL_GAME;
-        pkt.length      = sizeof(game_register_t);
-        
-        reg->type   = GAME_PACKET_REGISTER;
-        reg->game   = gr->game;
-        reg->flags  = flag;
-        reg->online = 0;
-        lownet_send( &pkt );
-		ESP_LOGW(TAG, "reg response %d to node %02x", (unsigned int)flag, (unsigned int)n );
-    }
-
-    /********************************************/
-    
-    if ( xSemaphoreTake( gamelukko, 1000 / portTICK_PERIOD_MS ) != pdTRUE )
-    {
-        respond( node, GAME_NACK );
+        register_respond( frame->source, gr->game, GAME_NACK );
         return;
     }
+    reg_ring[ head & (REG_RING-1) ].node = frame->source;
+    reg_ring[ head & (REG_RING-1) ].game = gr->game;
+    reg_ring[ head & (REG_RING-1) ].type = gr->type;
+    __atomic_store_n( &reg_head, head + 1, __ATOMIC_RELEASE );
+    xSemaphoreGive( shards[HOME].rearm );
+}
 
-    if ( !waiting_node )
+/*
+ *  Home: into the lobby, pairing happens in rounds
+ */
+void register_node( uint8_t node, uint8_t game )
+{
+    if ( tourney_member( &tourney, node ) )
     {
-		ESP_LOGW(TAG, "node %02x added to waiting list", (unsigned int)node );
-        waiting_node = node;
-        xSemaphoreGive( gamelukko );
-        respond( node, GAME_ACK );
+        register_respond( node, game, GAME_ACK );  // the tournament pairs it
         return;
     }
-    
-    /* start the game! */
-    uint8_t node2 = waiting_node;
-    waiting_node = 0;
-    xSemaphoreGive( gamelukko );
-    
-    if ( node2 == node && 0 )
+    if ( SELF_PLAY )
     {
-        respond( node, GAME_NACK );
+        register_respond( node, game, GAME_ACK );
+        start_newgame( game, node, node );
         return;
     }
+    int      e = game_engine_index( game );
+    lobby_t *L = &lobby[ e < 0 ? 0 : e ];
 
-    respond( node, GAME_ACK );  // quickly before anything happens
-
-    if ( !start_newgame( gr->game, node2, node ) )
+    if ( e < 0 || lobby_add( L, node, rating_get( node ), game_time() ) < 0 )
     {
-        respond( node,  GAME_NACK );  // too many games?!
-        respond( node2, GAME_NACK );
-		ESP_LOGW(TAG, "Game between %02x and %02x cancelled", (unsigned int)node, (unsigned int)node2 );
+        register_respond( node, game, GAME_NACK );
+        return;
     }
+    lobby_counted();
+    ESP_LOGW(TAG, "node %02x added to %s waiting list (%d waiting)", (unsigned int)node,
+             game_engines[e]->name, L->n );
+    register_respond( node, game, GAME_ACK );
 }
 
 
+/*
+ *  Leaderboard from the published snapshot, no locks
+ */
+void send_leaders( uint8_t node )
+{
+    lownet_frame_t  pkt;
+    game_leaders_t *gl = (game_leaders_t *)pkt.payload;
+    rating_top_t    top;
+
+    rating_top( &top );
+    pkt.source      = lownet_get_device_id();
+    pkt.destination = node;
+    pkt.protocol    = LOWNET_PROTOCOL_GAME;
+    pkt.length      = 3 + top.count*sizeof(game_leader_t);
+
+    gl->type  = GAME_PACKET_LEADERS;
+    gl->game  = GAME_TICTACTOE;
+    gl->count = top.count;
+    memcpy( gl->leader, top.leader, top.count*sizeof(game_leader_t) );
+    lownet_send( &pkt );
+}
+
 void gameserver_receive( const lownet_frame_t *frame ) 
 {
     const game_msg_header_t *g = (const game_msg_header_t *)frame->payload;
 
     if ( !gameserver_ok )                  /*  We are not setup as game server */
         return;
-    if ( g->game != GAME_TICTACTOE )  /*  Ignore silently games we have no idea about  */
+    if ( !game_engine( g->game ) )    /*  Ignore silently games we have no idea about  */
         return;
     
     switch (g->type)
     {
         case GAME_PACKET_REGISTER:  // Register to game
-            register_node( frame );
-            register_node( frame );  // debug mode, play against itself!
+        case GAME_PACKET_TOURNEY :  // ..or to the tournament
+            register_handoff( frame );
             break;
 
         case GAME_PACKET_STATUS:    // game active
         case GAME_PACKET_WINNER_1:  // game over
         case GAME_PACKET_WINNER_2:  // game over
         case GAME_PACKET_TIE     :  // and game over
+        case GAME_PACKET_DELTA   :
             /* these should come from us - ignore! */
             break;
             
         case GAME_PACKET_ACTION  :  // Player's action
+        case GAME_PACKET_RESYNC  :  // ..or wants the full board
+        case GAME_PACKET_WATCH   :  // spectator
             game_action( frame );
             break;
         case GAME_PACKET_QUIT    :  // Player informs about quiting
             /* IMPLEMENT -- GENERAL QUIT? */
             break;
+        case GAME_PACKET_LEADERS :
+            send_leaders( frame->source );
+            break;
     }
 }
 
 
+/*
+ *  Journal replay at boot, before the shards run: rebuild the games
+ *  that were running.  arg is the next free seq.
+ */
+void game_replay( const journal_rec_t *r, void *arg )
+{
+    uint32_t *next_seq = (uint32_t *)arg;
+    shard_t  *sh = shard_of( r->seq );
+    game_t   *g  = gamestore_find( &sh->store, r->seq );
+    uint8_t   game;
+
+    if ( r->seq >= *next_seq )
+        *next_seq = r->seq + 1;
+    if ( r->type == JOURNAL_RESULT )
+    {
+        if ( g )
+            gamestore_release( &sh->store, g );
+        return;
+    }
+    game = r->game ? r->game : GAME_TICTACTOE;   // older journals have no game in moves
+    if ( !game_engine( game ) )
+        return;
+    if ( !g )
+    {
+        if ( !(g = gamestore_alloc( &sh->store, r->seq )) )
+            return;
+        game_engine( game )->init( g->data );
+    }
+    g->state = STATE_RUNNING;
+    g->game  = game;
+    if ( r->type == JOURNAL_START )
+    {
+        g->node_1 = r->node_1;
+        g->node_2 = r->node_2;
+        if ( !g->round )
+            g->round = 1;
+    }
+    else if ( r->type == JOURNAL_MOVE )
+    {
+        game_engine( game )->place( g->data, r->x, r->y, 2 - (r->round & 1) );
+        if ( r->round >= g->round )
+            g->round = r->round + 1;
+    }
+}
+
+/*
+ *  Replayed games go on from where they were, with a fresh deadline
+ */
+int game_resume( shard_t *sh )
+{
+    uint64_t tnow = game_time();
+    int      n    = 0;
+
+    for( int i=0; i<sh->store.capacity; i++ )
+    {
+        game_t *g = &sh->store.games[i];
+
+        if ( g->next_free != -1 || g->state != STATE_RUNNING )
+            continue;
+        if ( !g->node_1 )   // start record lost, nobody to play it
+        {
+            gamestore_release( &sh->store, g );
+            continue;
+        }
+        g->last_move = tnow;
+        g->turn      = (g->round & 1) ? g->node_1 : g->node_2;
+        game_arm( sh, g, FIVE_SECONDS );
+        sh->active++;
+        send_full( sh, g, 0 );
+        n++;
+    }
+    return n;
+}
+
 /*
  *  Init something and check that configuration
  *  options make sense. If all is good, games_ok is set!
  */
 int gameserver_init( void )
 {
-    if ( MAX_STATE < sizeof(tictactoe_t) )
+    for( int i=0; i<GAME_ENGINES; i++ )
     {
-        ESP_LOGW(TAG,  "init_games failed: too small MAX_STATE" );
-        return -1;
+        if ( game_engines[i]->state_size > GAME_STATE_SIZE )
+        {
+            ESP_LOGW(TAG,  "init_games failed: too small GAME_STATE_SIZE for %s", game_engines[i]->name );
+            return -1;
+        }
     }
-    game_queue = xQueueCreate(20, sizeof(game_action_t));
-    msg_queue  = xQueueCreate(10, sizeof(announcement_t));
-    
-    if ( !game_queue )
+    msg_queue = xQueueCreate(10, sizeof(announcement_t));
+    results     = xQueueCreate(20, sizeof(game_result_t));
+    tourney_ctl = xQueueCreate(2, sizeof(tourney_ctl_t));
+    if ( !msg_queue || !results || !tourney_ctl )
     {
-        ESP_LOGW(TAG, "Error: game_queue could not be created!" );
+        ESP_LOGW(TAG, "Error: game server queues could not be created!" );
         return -1;
     }
 
-    gamelukko = xSemaphoreCreateBinary( );
-    xSemaphoreGive( gamelukko );
+    for( int i=0; i<GAME_SHARDS; i++ )
+    {
+        shard_t *sh = &shards[i];
+
+        sh->id      = i;
+        sh->actions = xQueueCreate(20, sizeof(game_action_t));
+        sh->starts  = xQueueCreate(LOBBY_MAX/2, sizeof(game_start_t));
+        sh->rearm   = xSemaphoreCreateBinary( );
+        sh->ready   = xQueueCreateSet( 20 + LOBBY_MAX/2 + 1 + (i==HOME ? 10 + 20 + 2 : 0) );
+        if ( !sh->actions || !sh->starts || !sh->rearm || !sh->ready ||
+             gamestore_init( &sh->store, GAMESTORE_GAMES / GAME_SHARDS ) )
+        {
+            ESP_LOGW(TAG, "Error: game shard %d could not be created!", i );
+            return -1;
+        }
+        xQueueAddToSet( sh->actions, sh->ready );
+        xQueueAddToSet( sh->starts,  sh->ready );
+        xQueueAddToSet( sh->rearm,   sh->ready );
+        if ( i==HOME )
+        {
+            xQueueAddToSet( msg_queue, sh->ready );
+            xQueueAddToSet( results,   sh->ready );
+            xQueueAddToSet( tourney_ctl, sh->ready );
+        }
+        tw_init( &sh->wheel, game_time() );
+    }
+
+    rating_init();
+
+    {
+        uint64_t t0 = esp_timer_get_time();
+        int      n  = 0;
+
+        if ( journal_init( game_replay, &next_game_seq ) > 0 )
+            for( int i=0; i<GAME_SHARDS; i++ )
+                n += game_resume( &shards[i] );
+        ESP_LOGI(TAG, "%d games resumed in %lu ms", n,
+                 (unsigned long)((esp_timer_get_time() - t0) / 1000) );
+    }
     
     gameserver_ok = 1;
 
-    xTaskCreate(
-        gameserver_loop,
-        "gameserver",
-        4092,
-        NULL,
-        PRIORITY_GAMESERVER,
-        0 );
+    for( int i=0; i<GAME_SHARDS; i++ )
+        xTaskCreatePinnedToCore(
+            gameserver_loop,
+            "gameserver",
+            4092,
+            &shards[i],
+            PRIORITY_GAMESERVER,
+            0,
+            i );
     
     return 0;
 }
 
 int gameserver_active( void )
 {
-    return gameserver_ok ? active_games : -1;
+    return gameserver_ok ? active_games() : -1;
+}
+
+/*
+ *  Leaderboard to the serial line
+ */
+int gameserver_leaders( void )
+{
+    rating_top_t top;
+    char         buf[80];
+
+    if ( !gameserver_ok )
+        return -1;
+    rating_top( &top );
+    serial_write_line( "Leaderboard" );
+    for( int i=0; i<top.count; i++ )
+    {
+        snprintf( buf, 80, " %2d. 0x%02x %5u (%u games)", i+1, (unsigned)top.leader[i].node,
+                  (unsigned)top.leader[i].rating, (unsigned)top.leader[i].games );
+        serial_write_line( buf );
+    }
+    return 0;
+}
+
+/*
+ *  Tournament from the serial line: "rr", "swiss N" and "start" go to
+ *  home, "" prints the standings
+ */
+int gameserver_tourney( const char *arg )
+{
+    tourney_ctl_t c = { 0, 0 };
+    uint8_t       idx[ TOURNEY_PLAYERS ];
+    char          buf[80];
+
+    if ( !gameserver_ok )
+        return -1;
+    while ( *arg == ' ' )
+        arg++;
+    if ( !*arg )
+    {
+        static const char *state[] = { "none", "open", "running", "over" };
+        int n = tourney_standings( &tourney, idx );
+
+        snprintf( buf, 80, "Tournament %s, round %d of %d", state[ tourney.state ],
+                  (int)tourney.round, (int)tourney.rounds );
+        serial_write_line( buf );
+        for( int i=0; i<n; i++ )
+        {
+            const tourney_player_t *p = &tourney.p[ idx[i] ];
+            snprintf( buf, 80, " %2d. 0x%02x %2u%s (%u games)", i+1, (unsigned)p->node,
+                      (unsigned)(p->score/2), (p->score & 1) ? ".5" : "  ", (unsigned)p->played );
+            serial_write_line( buf );
+        }
+        return 0;
+    }
+    if ( !strcmp( arg, "rr" ) )
+        c.mode = TOURNEY_RR;
+    else if ( !strncmp( arg, "swiss ", 6 ) && atoi( arg + 6 ) > 0 )
+    {
+        c.mode   = TOURNEY_SWISS;
+        c.rounds = atoi( arg + 6 );
+    }
+    else if ( strcmp( arg, "start" ) )
+        return -1;
+    return xQueueSend( tourney_ctl, &c, 0 ) == pdTRUE ? 0 : -1;
+}
+
+/*
+ *  Benchmark helpers: random moves on the n games of a table
+ */
+typedef struct
+{
+    shard_t           sh;       // store and work only
+    int               n;
+    int               rounds;
+    SemaphoreHandle_t done;
+} bench_t;
+
+static void bench_moves( shard_t *sh, int n, int rounds, uint32_t rnd )
+{
+    for( int r=0; r<rounds; r++ )
+    {
+        rnd = 1103515245*rnd + 12345;
+        game_t *g = find_game( sh, 1000 + 7*((rnd >> 8) % n) );
+        int     w = game_engine( g->game )->width;
+        int     x = (rnd >> 16) % w;
+        int     y = (rnd >> 24) % w;
+        if ( game_apply_move( sh, g, &x, &y, 1 + (r & 1) ) )
+            game_engine( g->game )->init( g->data );  // over or full-ish, start over
+    }
+}
+
+static int bench_table( shard_t *sh, int n, uint8_t game )
+{
+    if ( gamestore_init( &sh->store, n ) )
+        return -1;
+    for( int i=0; i<n; i++ )
+    {
+        game_t *g = gamestore_alloc( &sh->store, 1000 + 7*i );
+        g->state = STATE_RUNNING;
+        g->game  = game;
+        game_engine( game )->init( g->data );
+    }
+    return 0;
+}
+
+static void bench_worker( void *p )
+{
+    bench_t *b = (bench_t *)p;
+
+    bench_moves( &b->sh, b->n, b->rounds, 12345 + b->sh.id );
+    xSemaphoreGive( b->done );
+    vTaskDelete( 0 );
+}
+
+/*
+ *  Benchmark: actions/s through find_game and the engine of each game
+ *  for growing game tables, then moves/s with 1 and GAME_SHARDS shards
+ *  each on its own core.  Uses its own tables, needs the server off.
+ */
+int gameserver_benchmark( void )
+{
+    static bench_t b[ GAME_SHARDS ];
+    const int      rounds = 2000;
+    char           buf[80];
+
+    if ( gameserver_ok )
+    {
+        serial_write_line( "Game server running, benchmark would disturb it" );
+        return -1;
+    }
+    serial_write_line( "Game table benchmark:" );
+
+    for( int e=0; e<GAME_ENGINES; e++ )
+    {
+        for( int n=8; n<=GAMESTORE_GAMES; n*=4 )
+        {
+            if ( bench_table( &b[0].sh, n, game_engines[e]->game ) )
+                break;
+
+            uint64_t t0 = esp_timer_get_time();
+            bench_moves( &b[0].sh, n, rounds, 12345 );
+            t0 = esp_timer_get_time() - t0;
+            gamestore_free( &b[0].sh.store );
+
+            snprintf( buf, 80, "  %-12s %5d games: %lu actions/s", game_engines[e]->name, n,
+                      (unsigned long)(rounds * 1000000ull / (t0 ? t0 : 1)) );
+            serial_write_line( buf );
+        }
+    }
+
+    serial_write_line( "Shard benchmark:" );
+    for( int k=1; ; k=GAME_SHARDS )
+    {
+        SemaphoreHandle_t done = xSemaphoreCreateCounting( k, 0 );
+        int               ok   = 1;
+
+        for( int i=0; i<k; i++ )
+        {
+            b[i].sh.id  = i;
+            b[i].n      = GAMESTORE_GAMES / GAME_SHARDS;
+            b[i].rounds = 4*rounds;
+            b[i].done   = done;
+            if ( bench_table( &b[i].sh, b[i].n, GAME_TICTACTOE ) )
+                ok = 0;
+        }
+        if ( done && ok )
+        {
+            uint64_t t0 = esp_timer_get_time();
+            for( int i=0; i<k; i++ )
+                xTaskCreatePinnedToCore( bench_worker, "gamebench", 4092, &b[i],
+                                         PRIORITY_GAMESERVER, 0, i );
+            for( int i=0; i<k; i++ )
+                xSemaphoreTake( done, portMAX_DELAY );
+            t0 = esp_timer_get_time() - t0;
+
+            snprintf( buf, 80, "  %d shard(s): %lu moves/s", k,
+                      (unsigned long)(k * 4ull*rounds * 1000000ull / (t0 ? t0 : 1)) );
+            serial_write_line( buf );
+        }
+        for( int i=0; i<k; i++ )
+            gamestore_free( &b[i].sh.store );
+        if ( done )
+            vSemaphoreDelete( done );
+        if ( k == GAME_SHARDS )
+            break;
+    }
+    return 0;
 }
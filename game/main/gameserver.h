@@ -9,6 +9,9 @@ void gameserver_receive( const lownet_frame_t *frame );
 int  gameserver_init( void );
 
 int  gameserver_active( void );  // returns the number of active games, or -1 if disabled
+int  gameserver_leaders( void );    // leaderboard to serial, -1 if not a server
+int  gameserver_tourney( const char *arg );  // "rr", "swiss N", "start" or "" for standings
+int  gameserver_benchmark( void );
 
 
 
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#include "gamestore.h"
+
+#define TAG "gamestore.c"
+
+/*
+ *  Fibonacci hashing; the top bits of the product are the best mixed
+ */
+static inline uint32_t home_slot( const gamestore_t *st, uint32_t seq )
+{
+    return (seq * 2654435761u) >> st->shift;
+}
+
+static void *store_calloc( size_t n, size_t size )
+{
+#ifdef CONFIG_SPIRAM
+    void *p = heap_caps_calloc( n, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT );
+    if ( p )
+        return p;
+#endif
+    return calloc( n, size );
+}
+
+int gamestore_init( gamestore_t *st, int capacity )
+{
+    uint32_t size = 1;
+    uint8_t  bits = 0;
+
+    memset( st, 0, sizeof(gamestore_t) );
+    if ( capacity <= 0 )
+        return -1;
+    
+    while ( size < 2*(uint32_t)capacity )  // load factor at most 1/2
+    {
+        size <<= 1;
+        bits++;
+    }
+    st->games = store_calloc( capacity, sizeof(game_t) );
+    st->index = store_calloc( size, sizeof(int32_t) );
+    if ( !st->games || !st->index )
+    {
+        ESP_LOGE(TAG, "no memory for %d games", capacity );
+        gamestore_free( st );
+        return -1;
+    }
+    st->mask     = size - 1;
+    st->shift    = 32 - bits;
+    st->capacity = capacity;
+    memset( st->index, 0xff, size*sizeof(int32_t) );
+
+    /* chain all slots to the free list */
+    for( int i=0; i<capacity; i++ )
+        st->games[i].next_free = i+1 < capacity ? i+1 : -1;
+    st->free_head = 0;
+    return 0;
+}
+
+void gamestore_free( gamestore_t *st )
+{
+    free( st->games );
+    free( st->index );
+    memset( st, 0, sizeof(gamestore_t) );
+}
+
+game_t *gamestore_find( gamestore_t *st, uint32_t seq )
+{
+    uint32_t i = home_slot( st, seq );
+    int32_t  k;
+
+    while ( (k = st->index[i]) >= 0 )
+    {
+        if ( st->games[k].seq == seq )
+            return st->games + k;
+        i = (i+1) & st->mask;
+    }
+    return 0;
+}
+
+game_t *gamestore_alloc( gamestore_t *st, uint32_t seq )
+{
+    int32_t k = st->free_head;
+    if ( k < 0 )
+        return 0;
+
+    game_t *g = st->games + k;
+    st->free_head = g->next_free;
+    memset( g, 0, sizeof(game_t) );
+    g->seq       = seq;
+    g->next_free = -1;
+    
+    uint32_t i = home_slot( st, seq );
+    while ( st->index[i] >= 0 )
+        i = (i+1) & st->mask;
+    st->index[i] = k;
+    st->used++;
+    return g;
+}
+
+/*
+ *  Remove from the index with backward shift deletion, so that
+ *  no tombstones are needed and probe chains stay short
+ */
+void gamestore_release( gamestore_t *st, game_t *g )
+{
+    int32_t  k = g - st->games;
+    uint32_t i = home_slot( st, g->seq );
+
+    while ( st->index[i] != k )
+    {
+        if ( st->index[i] < 0 )
+        {
+            ESP_LOGE(TAG, "game %lu not indexed", (unsigned long)g->seq );
+            return;
+        }
+        i = (i+1) & st->mask;
+    }
+
+    uint32_t j = i;
+    while ( 1 )
+    {
+        j = (j+1) & st->mask;
+        if ( st->index[j] < 0 )
+            break;
+        uint32_t h = home_slot( st, st->games[ st->index[j] ].seq );
+        /* can the entry at j move back to the hole at i? */
+        if ( ((j - h) & st->mask) >= ((j - i) & st->mask) )
+        {
+            st->index[i] = st->index[j];
+            i = j;
+        }
+    }
+    st->index[i] = -1;
+
+    g->state     = 0;
+    g->next_free = st->free_head;
+    st->free_head = k;
+    st->used--;
+}
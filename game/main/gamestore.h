@@ -0,0 +1,61 @@
+#ifndef GAMESTORE_H
+#define GAMESTORE_H
+
+#include <stdint.h>
+
+#include "timerwheel.h"
+
+/*
+ *  Game table of the game server
+ *
+ *  - the state of a game is in the layout of its engine (gameengine.h),
+ *    GAME_STATE_SIZE octets fit the largest, a 2-bit packed tictactoe
+ *  - seq -> slot through an open addressing (linear probing) index
+ *  - unused slots are chained to a free list
+ *
+ *  The table is allocated at init time; with PSRAM enabled it goes
+ *  there, otherwise it comes from the ordinary heap.
+ */
+
+#ifdef CONFIG_SPIRAM
+#define GAMESTORE_GAMES   2048
+#else
+#define GAMESTORE_GAMES    128
+#endif
+
+#define GAME_STATE_SIZE   240
+
+typedef struct
+{
+    uint64_t  last_move;  // internal clock of our ESP32
+    uint32_t  seq;        // game id number
+    uint16_t  round;      // current round
+    uint8_t   state;      // STATE_xyz of gameserver.c
+    uint8_t   game;       // what game is this
+    uint8_t   turn;       // whose turn, node id; or 0 if game over
+    uint8_t   node_1;
+    uint8_t   node_2;
+    int32_t   next_free;  // free list link, -1 when in use
+    tw_node_t timer;      // move timeout or slot reclamation
+    uint8_t   data[GAME_STATE_SIZE] __attribute__((aligned(8)));  // engine state
+} game_t;
+
+typedef struct
+{
+    game_t   *games;      // capacity slots
+    int32_t  *index;      // mask+1 entries, slot number or -1
+    uint32_t  mask;
+    uint8_t   shift;      // 32 - log2(mask+1)
+    int32_t   free_head;
+    int       capacity;
+    int       used;
+} gamestore_t;
+
+int     gamestore_init(  gamestore_t *st, int capacity );
+void    gamestore_free(  gamestore_t *st );
+
+game_t *gamestore_alloc( gamestore_t *st, uint32_t seq );  // zeroed game, or 0 if full
+game_t *gamestore_find(  gamestore_t *st, uint32_t seq );
+void    gamestore_release( gamestore_t *st, game_t *g );
+
+#endif
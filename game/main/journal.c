@@ -0,0 +1,390 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_partition.h>
+
+#include "journal.h"
+#include "gamestore.h"
+#include "serial_io.h"
+
+#define TAG "journal.c"
+
+#define SECTOR         4096
+#define MAGIC          0x4c4e524au   // "JRNL"
+#define JOURNAL_LIVE   GAMESTORE_GAMES
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t  magic;
+    uint32_t  epoch;    // one more for each sector started
+    uint8_t   pad[8];
+} sector_hdr_t;
+
+#define PER_SECTOR   ((SECTOR - sizeof(sector_hdr_t)) / sizeof(journal_rec_t))   // 255
+#define ROOM         (PER_SECTOR / 4)   // free in a sector started, at least
+
+static const esp_partition_t *part = 0;   // no journal if 0
+static int            sectors;
+static int            cur;              // sector we append to
+static int            used;             // records in it
+static uint32_t       epoch;            // of cur
+
+/*  appends from all shards, under lock; flushed by home  */
+static portMUX_TYPE   lock = portMUX_INITIALIZER_UNLOCKED;
+static journal_rec_t  buf[2][ JOURNAL_BUFFER ];
+static int            side;
+static int            fill;
+static int            dropped;
+static uint32_t       live[ JOURNAL_LIVE ];   // seqs of running games
+static int            nlive;
+
+static uint64_t       due = 0;
+
+/********************************************************************************/
+
+static uint32_t rec_check( const journal_rec_t *r )
+{
+    const uint8_t *p = (const uint8_t *)r;
+    uint32_t       h = 2166136261u;   // FNV-1a
+
+    for( int i=0; i<offsetof(journal_rec_t, check); i++ )
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static int rec_valid( const journal_rec_t *r )
+{
+    return r->type != 0xff && r->check == rec_check( r );
+}
+
+/*
+ *  Running games; caller holds the lock or runs before the shards
+ */
+static void live_track( const journal_rec_t *r )
+{
+    if ( r->type == JOURNAL_START )
+    {
+        for( int i=0; i<nlive; i++ )
+            if ( live[i] == r->seq )
+                return;
+        if ( nlive < JOURNAL_LIVE )
+            live[ nlive++ ] = r->seq;
+    }
+    else if ( r->type == JOURNAL_RESULT )
+    {
+        for( int i=0; i<nlive; i++ )
+            if ( live[i] == r->seq )
+            {
+                live[i] = live[ --nlive ];
+                return;
+            }
+    }
+}
+
+static int seq_cmp( const void *a, const void *b )
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void append( journal_rec_t *r )
+{
+    if ( !part )
+        return;
+    r->check = rec_check( r );
+
+    taskENTER_CRITICAL( &lock );
+    if ( fill < JOURNAL_BUFFER )
+        buf[side][ fill++ ] = *r;
+    else
+        dropped++;
+    live_track( r );
+    taskEXIT_CRITICAL( &lock );
+}
+
+/********************************************************************************/
+
+/*
+ *  Move on to the oldest sector: copy forward the records of games
+ *  still running, then erase it and start it with the next epoch.
+ *  If they would leave less than ROOM, the oldest games are dropped
+ *  from the journal; their start record goes too, so a replay does
+ *  not resume them.
+ */
+static int next_sector( void )
+{
+    static journal_rec_t keep[ PER_SECTOR ];
+    static uint32_t      snap[ JOURNAL_LIVE ];
+    int          nxt   = (cur + 1) % sectors;
+    int          nkeep = 0;
+    int          nsnap;
+    sector_hdr_t hdr   = { MAGIC, epoch + 1, { 0 } };
+
+    taskENTER_CRITICAL( &lock );
+    nsnap = nlive;
+    memcpy( snap, live, nsnap*sizeof(uint32_t) );
+    taskEXIT_CRITICAL( &lock );
+    qsort( snap, nsnap, sizeof(uint32_t), seq_cmp );
+
+    if ( esp_partition_read( part, nxt*SECTOR + sizeof(sector_hdr_t), keep, sizeof(keep) ) == ESP_OK )
+    {
+        for( int i=0; i<PER_SECTOR; i++ )
+            if ( rec_valid( &keep[i] ) &&
+                 bsearch( &keep[i].seq, snap, nsnap, sizeof(uint32_t), seq_cmp ) )
+                keep[ nkeep++ ] = keep[i];
+    }
+    while ( nkeep > PER_SECTOR - ROOM )
+    {
+        journal_rec_t end = { .type = JOURNAL_RESULT, .seq = keep[0].seq };
+        int           n   = 0;
+
+        for( int i=1; i<nkeep; i++ )
+            if ( keep[i].seq < end.seq )
+                end.seq = keep[i].seq;
+        for( int i=0; i<nkeep; i++ )
+            if ( keep[i].seq != end.seq )
+                keep[ n++ ] = keep[i];
+        ESP_LOGW(TAG, "journal full, game %lu dropped (%d records)",
+                 (unsigned long)end.seq, nkeep - n );
+        nkeep = n;
+        taskENTER_CRITICAL( &lock );
+        live_track( &end );   // not copied again
+        taskEXIT_CRITICAL( &lock );
+    }
+    if ( esp_partition_erase_range( part, nxt*SECTOR, SECTOR ) != ESP_OK ||
+         esp_partition_write( part, nxt*SECTOR, &hdr, sizeof(hdr) ) != ESP_OK )
+    {
+        ESP_LOGE(TAG, "cannot start sector %d", nxt );
+        return -1;
+    }
+    cur   = nxt;
+    epoch = hdr.epoch;
+    used  = 0;
+    if ( nkeep &&
+         esp_partition_write( part, cur*SECTOR + sizeof(sector_hdr_t), keep,
+                              nkeep*sizeof(journal_rec_t) ) == ESP_OK )
+        used = nkeep;
+    return 0;
+}
+
+static void write_records( const journal_rec_t *r, int n )
+{
+    while ( n > 0 )
+    {
+        if ( used == PER_SECTOR && next_sector() )
+            return;
+
+        int k = n < PER_SECTOR - used ? n : PER_SECTOR - used;
+        if ( esp_partition_write( part, cur*SECTOR + sizeof(sector_hdr_t) + used*sizeof(journal_rec_t),
+                                  r, k*sizeof(journal_rec_t) ) != ESP_OK )
+            ESP_LOGE(TAG, "write failed at sector %d", cur );
+        used += k;
+        r    += k;
+        n    -= k;
+    }
+}
+
+/********************************************************************************/
+
+int journal_init( journal_cb_t replay, void *arg )
+{
+    static uint8_t sec[ SECTOR ];
+    uint32_t       first_epoch = UINT32_MAX;
+    int            first = -1;
+    int            count = 0;
+    sector_hdr_t   hdr;
+
+    part = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION );
+    if ( !part || part->size < 2*SECTOR )
+    {
+        ESP_LOGW(TAG, "no journal partition, games do not survive a restart" );
+        part = 0;
+        return -1;
+    }
+    sectors = part->size / SECTOR;
+
+    /* the oldest and the newest sector */
+    cur   = -1;
+    epoch = 0;
+    for( int s=0; s<sectors; s++ )
+    {
+        if ( esp_partition_read( part, s*SECTOR, &hdr, sizeof(hdr) ) != ESP_OK || hdr.magic != MAGIC )
+            continue;
+        if ( hdr.epoch < first_epoch ) { first_epoch = hdr.epoch; first = s; }
+        if ( hdr.epoch >= epoch )      { epoch = hdr.epoch;       cur   = s; }
+    }
+    if ( cur < 0 )
+    {
+        hdr = (sector_hdr_t){ MAGIC, 1, { 0 } };
+        cur   = 0;
+        epoch = 1;
+        used  = 0;
+        if ( esp_partition_erase_range( part, 0, SECTOR ) != ESP_OK ||
+             esp_partition_write( part, 0, &hdr, sizeof(hdr) ) != ESP_OK )
+            part = 0;
+        ESP_LOGI(TAG, "new journal" );
+        return part ? 0 : -1;
+    }
+
+    /* replay in the order written, sectors have consecutive epochs */
+    used = PER_SECTOR;
+    for( int k=0; k<sectors; k++ )
+    {
+        int s = (first + k) % sectors;
+        const journal_rec_t *r = (const journal_rec_t *)(sec + sizeof(sector_hdr_t));
+
+        if ( esp_partition_read( part, s*SECTOR, sec, SECTOR ) != ESP_OK )
+            continue;
+        memcpy( &hdr, sec, sizeof(hdr) );
+        if ( hdr.magic != MAGIC || hdr.epoch != first_epoch + k )
+            continue;
+        for( int i=0; i<PER_SECTOR; i++ )
+        {
+            if ( r[i].type == 0xff )   // erased: end of the journal
+            {
+                if ( s == cur )
+                    used = i;
+                break;
+            }
+            if ( !rec_valid( &r[i] ) )
+                continue;
+            live_track( &r[i] );
+            replay( &r[i], arg );
+            count++;
+        }
+        if ( s == cur )
+            break;
+    }
+    ESP_LOGI(TAG, "%d records replayed, %d games running", count, nlive );
+    return count;
+}
+
+void journal_start( uint32_t seq, uint8_t game, uint8_t node_1, uint8_t node_2 )
+{
+    journal_rec_t r = { .type = JOURNAL_START, .game = game, .node_1 = node_1, .node_2 = node_2, .seq = seq };
+    append( &r );
+}
+
+void journal_move( uint32_t seq, uint8_t game, uint16_t round, uint8_t x, uint8_t y )
+{
+    journal_rec_t r = { .type = JOURNAL_MOVE, .game = game, .seq = seq, .round = round, .x = x, .y = y };
+    append( &r );
+}
+
+void journal_result( uint32_t seq, uint8_t state )
+{
+    journal_rec_t r = { .type = JOURNAL_RESULT, .seq = seq, .x = state };
+    append( &r );
+}
+
+/*
+ *  Buffered records to flash, once the batch window is over or the
+ *  buffer is half full (or forced)
+ */
+uint64_t journal_flush( uint64_t now, int force )
+{
+    journal_rec_t *out;
+    int            n;
+
+    if ( !part || !fill )
+        return 0;
+    if ( !due )
+        due = now + JOURNAL_FLUSH_MS;
+    if ( !force && now < due && fill < JOURNAL_BUFFER/2 )
+        return due;
+
+    taskENTER_CRITICAL( &lock );
+    out   = buf[side];
+    n     = fill;
+    side ^= 1;
+    fill  = 0;
+    taskEXIT_CRITICAL( &lock );
+
+    due = 0;
+    write_records( out, n );
+    if ( dropped )
+    {
+        ESP_LOGW(TAG, "%d records dropped, buffer full", dropped );
+        dropped = 0;
+    }
+    return 0;
+}
+
+/*
+ *  Completed games to the serial line, one event per line:
+ *    seq,start,node_1,node_2,game
+ *    seq,move,round,x,y
+ *    seq,result,state
+ */
+int journal_export( void )
+{
+    static uint8_t sec[ SECTOR ];
+    const journal_rec_t *r = (const journal_rec_t *)(sec + sizeof(sector_hdr_t));
+    uint32_t *done;
+    int       ndone = 0;
+    int       lines = 0;
+    char      line[48];
+
+    if ( !part )
+    {
+        serial_write_line( "No journal" );
+        return -1;
+    }
+    done = malloc( sectors*PER_SECTOR*sizeof(uint32_t) );
+    if ( !done )
+        return -1;
+
+    /* pass 1: which games have a result */
+    for( int s=0; s<sectors; s++ )
+        if ( esp_partition_read( part, s*SECTOR, sec, SECTOR ) == ESP_OK &&
+             ((sector_hdr_t *)sec)->magic == MAGIC )
+            for( int i=0; i<PER_SECTOR && r[i].type != 0xff; i++ )
+                if ( r[i].type == JOURNAL_RESULT && rec_valid( &r[i] ) )
+                    done[ ndone++ ] = r[i].seq;
+    qsort( done, ndone, sizeof(uint32_t), seq_cmp );
+
+    /* pass 2: their events */
+    serial_write_line( "seq,event,..." );
+    for( int s=0; s<sectors; s++ )
+    {
+        if ( esp_partition_read( part, s*SECTOR, sec, SECTOR ) != ESP_OK ||
+             ((sector_hdr_t *)sec)->magic != MAGIC )
+            continue;
+        for( int i=0; i<PER_SECTOR && r[i].type != 0xff; i++ )
+        {
+            if ( !rec_valid( &r[i] ) ||
+                 !bsearch( &r[i].seq, done, ndone, sizeof(uint32_t), seq_cmp ) )
+                continue;
+            switch ( r[i].type )
+            {
+                case JOURNAL_START:
+                    snprintf( line, sizeof(line), "%lu,start,0x%02x,0x%02x,%u", (unsigned long)r[i].seq,
+                              (unsigned)r[i].node_1, (unsigned)r[i].node_2, (unsigned)r[i].game );
+                    break;
+                case JOURNAL_MOVE:
+                    snprintf( line, sizeof(line), "%lu,move,%u,%u,%u", (unsigned long)r[i].seq,
+                              (unsigned)r[i].round, (unsigned)r[i].x, (unsigned)r[i].y );
+                    break;
+                default:
+                    snprintf( line, sizeof(line), "%lu,result,%u", (unsigned long)r[i].seq,
+                              (unsigned)r[i].x );
+                    break;
+            }
+            serial_write_line( line );
+            if ( !(++lines % 16) )
+                vTaskDelay( 20 / portTICK_PERIOD_MS );  // let the serial queue drain
+        }
+    }
+    free( done );
+    snprintf( line, sizeof(line), "%d games, %d lines", ndone, lines );
+    serial_write_line( line );
+    return 0;
+}
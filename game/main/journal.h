@@ -0,0 +1,51 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+/*
+ *  Append-only journal of game events in the "journal" partition
+ *
+ *  - the partition is a ring of 4 KB sectors, each a header and 255
+ *    records; the oldest sector is erased when the ring wraps, so the
+ *    erases go round the whole partition
+ *  - records are buffered in RAM and written in batches by
+ *    journal_flush(); a crash loses at most the last batch
+ *  - records of games still running are copied forward before their
+ *    sector is erased, so a replay always finds every running game
+ *
+ *  Replay is order independent per game: a board is the union of its
+ *  moves and the round follows the latest one.
+ */
+
+#define JOURNAL_PARTITION  "journal"
+#define JOURNAL_FLUSH_MS      250   // batch window
+#define JOURNAL_BUFFER        128   // records per batch, at most
+
+#define JOURNAL_START        0x01   // seq, game, node_1, node_2
+#define JOURNAL_MOVE         0x02   // seq, game, round, x, y (the square taken)
+#define JOURNAL_RESULT       0x03   // seq, state (in x)
+
+typedef struct __attribute__((__packed__))
+{
+    uint8_t   type;     // JOURNAL_xyz, 0xff in erased flash
+    uint8_t   game;
+    uint8_t   node_1;
+    uint8_t   node_2;
+    uint32_t  seq;
+    uint16_t  round;    // of the move
+    uint8_t   x;
+    uint8_t   y;
+    uint32_t  check;    // of the above, catches torn writes
+} journal_rec_t;
+
+typedef void (*journal_cb_t)( const journal_rec_t *r, void *arg );
+
+int      journal_init(  journal_cb_t replay, void *arg );  // records replayed, -1 if no journal
+void     journal_start(  uint32_t seq, uint8_t game, uint8_t node_1, uint8_t node_2 );
+void     journal_move(   uint32_t seq, uint8_t game, uint16_t round, uint8_t x, uint8_t y );
+void     journal_result( uint32_t seq, uint8_t state );
+uint64_t journal_flush(  uint64_t now, int force );        // next flush due, 0 = nothing buffered
+int      journal_export( void );                           // completed games to serial
+
+#endif
@@ -0,0 +1,745 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef LOADGEN_HOST
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_random.h>
+#include "esp_timer.h"
+
+#include "serial_io.h"
+#endif
+
+#include "games.h"
+#include "tictactoe.h"
+#include "loadgen.h"
+
+#define TAG "loadgen.c"
+
+#define PRIORITY_LOADGEN   5
+
+#define LG_IDLE            0    // registers when due
+#define LG_REGISTERING     1
+#define LG_WAITING         2    // for a game
+#define LG_PLAYING         3
+
+#define LG_RETRY_MS     2000    // no answer to a registration
+#define LG_WAIT_MS     30000    // no game, register again
+#define LG_LOST_MS      6000    // no answer to a move, the server gave up too
+#define LG_BACKOFF_MS    500    // after a NACK, plus as much at random
+#define LG_TICK_MS       100    // look at the players at least this often
+
+typedef struct
+{
+    uint8_t      node;
+    uint8_t      state;     // LG_xyz
+    uint8_t      node_1;
+    uint8_t      node_2;
+    uint32_t     seq;
+    uint32_t     round;     // latest seen, one more once we moved
+    uint64_t     due;       // next registration or move, 0 = none
+    uint64_t     sent;      // move waiting for ACK since, 0 = none
+    uint32_t     digest;
+    tictactoe_t  board;
+} vplayer_t;
+
+static loadgen_conf_t   conf;
+static vplayer_t       *vp;       // conf.players of them
+static loadgen_stats_t  st;
+
+static uint64_t lg_now( void );
+static uint32_t lg_random( void );
+static void     lg_send( lownet_frame_t *f );
+static void     lg_line( const char *s );
+
+/********************************************************************************/
+
+static vplayer_t *vplayer( uint8_t node )
+{
+    if ( !vp || node < LOADGEN_FIRST || node - LOADGEN_FIRST >= conf.players )
+        return NULL;
+    return &vp[ node - LOADGEN_FIRST ];
+}
+
+static int my_turn( const vplayer_t *p, uint32_t round )
+{
+    return ((round & 1) ? p->node_1 : p->node_2) == p->node;
+}
+
+static uint32_t think( void )
+{
+    uint32_t m = conf.think_ms;
+
+    switch( conf.dist )
+    {
+        case LOADGEN_UNIFORM:
+            return lg_random() % (2*m + 1);
+        case LOADGEN_EXP:
+        {
+            double u = (lg_random() + 1.0) / 4294967297.0;   // (0,1]
+            double t = -log( u ) * m;
+            return t < 10.0*m ? (uint32_t)t : 10*m;         // no endless tail
+        }
+        default:
+            return m;
+    }
+}
+
+static void rtt_sample( uint32_t ms )
+{
+    uint32_t bin = ms / LOADGEN_RTT_BIN;
+
+    st.rtt[ bin < LOADGEN_RTT_BINS ? bin : LOADGEN_RTT_BINS ]++;
+    if ( ms > st.rtt_max )
+        st.rtt_max = ms;
+}
+
+/*
+ *  Upper bound of the bin with the q-th fraction of the samples
+ */
+static uint32_t rtt_percentile( double q )
+{
+    uint32_t n = 0, k = 0;
+
+    for( int i=0; i<=LOADGEN_RTT_BINS; i++ )
+        n += st.rtt[i];
+    for( int i=0; i<LOADGEN_RTT_BINS; i++ )
+    {
+        k += st.rtt[i];
+        if ( k && k >= q*n )
+            return (i + 1)*LOADGEN_RTT_BIN < st.rtt_max ? (i + 1)*LOADGEN_RTT_BIN : st.rtt_max;
+    }
+    return n ? st.rtt_max : 0;
+}
+
+static void send_game( vplayer_t *p, const void *msg, int len )
+{
+    lownet_frame_t f;
+
+    memset( &f, 0, sizeof(f) );
+    f.source      = p->node;
+    f.destination = conf.server;
+    f.protocol    = LOWNET_PROTOCOL_GAME;
+    f.length      = len;
+    memcpy( f.payload, msg, len );
+    lg_send( &f );
+}
+
+static void send_register( vplayer_t *p, uint64_t now )
+{
+    game_register_t r = { GAME_PACKET_REGISTER, GAME_TICTACTOE, 0, 0, 0 };
+
+    send_game( p, &r, sizeof(r) );
+    p->state = LG_REGISTERING;
+    p->due   = now + LG_RETRY_MS;
+    st.registers++;
+}
+
+static void send_resync( vplayer_t *p )
+{
+    game_action_t ga;
+
+    memset( &ga, 0, sizeof(ga) );
+    ga.type = GAME_PACKET_RESYNC;
+    ga.game = GAME_TICTACTOE;
+    ga.seq  = p->seq;
+    ga.node = p->node;
+    send_game( p, &ga, sizeof(ga) );
+    st.resyncs++;
+}
+
+static void play( vplayer_t *p, uint64_t now )
+{
+    game_action_t ga;
+    uint8_t       s = 2 - (p->round & 1);
+    int           x, y;
+
+    if ( tictac_auto( &p->board, &x, &y, s ) || tictac_set( &p->board, x, y, s ) )
+    {
+        send_resync( p );   // the board is not what the server has
+        return;
+    }
+    p->digest ^= tictac_dcell( x, y, s );
+
+    memset( &ga, 0, sizeof(ga) );
+    ga.type     = GAME_PACKET_ACTION;
+    ga.game     = GAME_TICTACTOE;
+    ga.seq      = p->seq;
+    ga.round    = p->round;
+    ga.node     = p->node;
+    ga.move_x   = x;
+    ga.move_y   = y;
+    ga.checksum = tictac_checksum( &p->board );
+    send_game( p, &ga, sizeof(ga) );
+
+    p->round++;
+    p->sent = now;
+    st.moves++;
+}
+
+/*
+ *  Game at round: think if it is our move and we are not at it yet
+ */
+static void game_turn( vplayer_t *p, uint32_t round, uint64_t now )
+{
+    if ( round < p->round || (round == p->round && p->due) )
+        return;
+    p->round = round;
+    p->due   = my_turn( p, round ) && !p->sent ? now + think() : 0;
+}
+
+/*
+ *  Full status, broadcast: to every player in the game
+ */
+static void lg_status( const lownet_frame_t *f, uint64_t now )
+{
+    const game_status_t *gs = (const game_status_t *)f->payload;
+    tictactoe_t          b;
+    int                  decoded = 0, counted = 0;
+
+    for( int i=0; i<conf.players; i++ )
+    {
+        vplayer_t *p = &vp[i];
+
+        if ( p->state == LG_WAITING ? gs->type != GAME_PACKET_STATUS || gs->seq <= p->seq ||
+                                      (gs->node_1 != p->node && gs->node_2 != p->node)
+                                    : p->state != LG_PLAYING || gs->seq != p->seq )
+            continue;   // not ours, or a late one of the previous game
+        if ( p->state == LG_PLAYING && gs->type == GAME_PACKET_STATUS && gs->round < p->round )
+            continue;   // older than the move we made
+        if ( !decoded && tictac_decode( (const tictactoe_payload_t *)&f->payload[GAME_STATUS_HEADER], &b ) )
+            return;
+        decoded = 1;
+
+        p->board  = b;
+        p->digest = tictac_digest( &b );
+        p->node_1 = gs->node_1;
+        p->node_2 = gs->node_2;
+        if ( gs->type == GAME_PACKET_STATUS )
+        {
+            if ( p->state == LG_WAITING )
+            {
+                st.games += !counted;
+                p->state  = LG_PLAYING;
+                p->seq    = gs->seq;
+                p->round  = 0;
+                p->due    = 0;
+            }
+            game_turn( p, gs->round, now );
+        }
+        else
+        {
+            if ( !counted )
+            {
+                st.over++;
+                if ( gs->type == GAME_PACKET_TIE )
+                    st.ties++;
+                else if ( !tictac_game_over( &b ) )
+                    st.forfeits++;
+            }
+            p->state = LG_IDLE;
+            p->sent  = 0;
+            p->due   = now + think();
+        }
+        counted = 1;
+    }
+}
+
+/*
+ *  Delta status: the last moves, as in games.c but without the display
+ */
+static void lg_delta( const game_delta_t *gd, uint64_t now )
+{
+    for( int i=0; i<conf.players; i++ )
+    {
+        vplayer_t *p   = &vp[i];
+        int        bad = gd->moves > GAME_DELTA_MOVES || gd->round < gd->moves + 1;
+
+        if ( p->state != LG_PLAYING || gd->seq != p->seq || gd->round < p->round )
+            continue;
+        for( int k=GAME_DELTA_MOVES - gd->moves; !bad && k<GAME_DELTA_MOVES; k++ )
+        {
+            int     x = gd->move_x[k];
+            int     y = gd->move_y[k];
+            uint8_t s = 2 - ((gd->round - GAME_DELTA_MOVES + k) & 1);
+
+            if ( x >= TICTACTOE_BOARD || y >= TICTACTOE_BOARD )
+                bad = 1;
+            else if ( tictac_get( &p->board, x, y ) != s )
+            {
+                bad = tictac_set( &p->board, x, y, s );
+                p->digest ^= tictac_dcell( x, y, s );
+            }
+        }
+        if ( bad || p->digest != gd->digest )
+            send_resync( p );
+        else
+            game_turn( p, gd->round, now );
+    }
+}
+
+static void lg_frame( const lownet_frame_t *f, uint64_t now )
+{
+    const game_msg_header_t *h = (const game_msg_header_t *)f->payload;
+    vplayer_t               *p = vplayer( f->destination );
+
+    if ( h->game != GAME_TICTACTOE )
+        return;
+    switch( h->type )
+    {
+        case GAME_PACKET_REGISTER:
+        {
+            const game_register_t *r = (const game_register_t *)f->payload;
+
+            if ( !p || p->state != LG_REGISTERING )
+                break;
+            if ( r->flags == GAME_ACK )
+            {
+                p->state = LG_WAITING;
+                p->due   = now + LG_WAIT_MS;
+            }
+            else
+            {
+                st.reg_nacks++;
+                p->state = LG_IDLE;
+                p->due   = now + LG_BACKOFF_MS + lg_random() % LG_BACKOFF_MS;
+            }
+            break;
+        }
+        case GAME_PACKET_ACTION:
+        {
+            const game_action_t *ga = (const game_action_t *)f->payload;
+
+            if ( !p || !p->sent || ga->seq != p->seq )
+                break;
+            rtt_sample( now - p->sent );
+            p->sent = 0;
+            if ( ga->flags != GAME_ACK )
+            {
+                st.move_nacks++;
+                p->round = ga->round;   // take it back, the status tells what next
+                p->due   = 0;
+                send_resync( p );
+            }
+            else if ( my_turn( p, p->round ) )   // the next status beat the ACK
+                p->due = now + think();
+            break;
+        }
+        case GAME_PACKET_STATUS:
+        case GAME_PACKET_WINNER_1:
+        case GAME_PACKET_WINNER_2:
+        case GAME_PACKET_TIE:
+            lg_status( f, now );
+            break;
+        case GAME_PACKET_DELTA:
+            lg_delta( (const game_delta_t *)f->payload, now );
+            break;
+    }
+}
+
+/*
+ *  Registrations and moves that are due; returns when to look again
+ */
+static uint64_t lg_tick( uint64_t now )
+{
+    uint64_t next = now + LG_TICK_MS;
+
+    st.t_now = now;
+    for( int i=0; i<conf.players; i++ )
+    {
+        vplayer_t *p = &vp[i];
+
+        if ( p->sent && now - p->sent > LG_LOST_MS )
+        {
+            st.lost++;
+            p->sent = 0;
+        }
+        if ( p->due && p->due <= now )
+        {
+            p->due = 0;
+            if ( p->state == LG_PLAYING )
+                play( p, now );
+            else
+                send_register( p, now );
+        }
+        if ( p->due && p->due < next )
+            next = p->due;
+    }
+    return next;
+}
+
+static int lg_init( const loadgen_conf_t *c, uint64_t now )
+{
+    if ( !c->players || c->players > LOADGEN_PLAYERS || !c->server )
+        return -1;
+    vp = calloc( c->players, sizeof(vplayer_t) );
+    if ( !vp )
+        return -1;
+    conf = *c;
+    memset( &st, 0, sizeof(st) );
+    st.t_start = st.t_now = now;
+    for( int i=0; i<conf.players; i++ )
+    {
+        vp[i].node = LOADGEN_FIRST + i;
+        vp[i].due  = now + 1 + 5*i;   // spread the registrations
+    }
+    return 0;
+}
+
+static void lg_report( void )
+{
+    char     buf[100];
+    double   t = (st.t_now - st.t_start) / 1000.0;
+
+    if ( t <= 0 )
+        t = 1e-3;
+    snprintf( buf, sizeof(buf), "Load of %d players (0x%02x..) on 0x%02x, %.1f s",
+              (int)conf.players, LOADGEN_FIRST, (unsigned)conf.server, t );
+    lg_line( buf );
+    snprintf( buf, sizeof(buf), " games %lu started, %lu over (%.2f/s), %lu ties, %lu forfeits",
+              (unsigned long)st.games, (unsigned long)st.over, st.over / t,
+              (unsigned long)st.ties, (unsigned long)st.forfeits );
+    lg_line( buf );
+    snprintf( buf, sizeof(buf), " moves %lu (%.1f/s), %lu NACKs, %lu lost, %lu resyncs",
+              (unsigned long)st.moves, st.moves / t, (unsigned long)st.move_nacks,
+              (unsigned long)st.lost, (unsigned long)st.resyncs );
+    lg_line( buf );
+    snprintf( buf, sizeof(buf), " registrations %lu, %lu NACKs, %lu frames dropped",
+              (unsigned long)st.registers, (unsigned long)st.reg_nacks, (unsigned long)st.dropped );
+    lg_line( buf );
+    snprintf( buf, sizeof(buf), " move RTT ms: p50 %lu  p90 %lu  p99 %lu  max %lu",
+              (unsigned long)rtt_percentile( 0.5 ), (unsigned long)rtt_percentile( 0.9 ),
+              (unsigned long)rtt_percentile( 0.99 ), (unsigned long)st.rtt_max );
+    lg_line( buf );
+}
+
+/********************************************************************************/
+
+#ifndef LOADGEN_HOST
+
+static QueueHandle_t  inbox;          // frames for the virtual nodes
+static TaskHandle_t   task;
+static volatile int   running = 0;
+
+static uint64_t lg_now( void )
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static uint32_t lg_random( void )
+{
+    return esp_random();
+}
+
+static void lg_send( lownet_frame_t *f )
+{
+    lownet_ext_bake( f );   // keeps our source
+    lownet_ext_send( f );
+}
+
+static void lg_line( const char *s )
+{
+    serial_write_line( s );
+}
+
+/*
+ *  All the virtual players in one task: frames in, moves out
+ */
+void loadgen_task( void *arg )
+{
+    lownet_frame_t f;
+    uint64_t       next = lg_now();
+
+    while ( running )
+    {
+        uint64_t   now  = lg_now();
+        TickType_t wait = next > now ? pdMS_TO_TICKS( next - now ) : 0;
+
+        if ( xQueueReceive( inbox, &f, wait ) == pdTRUE )
+            lg_frame( &f, lg_now() );
+        next = lg_tick( lg_now() );
+    }
+    lownet_ext_accept( 0, 0 );
+    free( vp );
+    vp   = NULL;
+    task = NULL;
+    vTaskDelete( NULL );
+}
+
+int loadgen_start( const loadgen_conf_t *c )
+{
+    if ( task )
+        return -1;
+    if ( !inbox && !(inbox = xQueueCreate( 32, sizeof(lownet_frame_t) )) )
+        return -1;
+    xQueueReset( inbox );
+    if ( lg_init( c, lg_now() ) )
+        return -1;
+    lownet_ext_accept( LOADGEN_FIRST, conf.players );
+    running = 1;
+    if ( xTaskCreate( loadgen_task, "loadgen", 4096, NULL, PRIORITY_LOADGEN, &task ) != pdPASS )
+    {
+        running = 0;
+        lownet_ext_accept( 0, 0 );
+        free( vp );
+        vp = NULL;
+        return -1;
+    }
+    ESP_LOGI(TAG, "%d virtual players on server 0x%02x", (int)conf.players, (unsigned)conf.server );
+    return 0;
+}
+
+void loadgen_stop( void )
+{
+    running = 0;   // the task cleans up
+}
+
+int loadgen_report( void )
+{
+    if ( !conf.players )
+    {
+        serial_write_line( "Load generator has not run" );
+        return -1;
+    }
+    lg_report();
+    return 0;
+}
+
+/*
+ *  From the lownet task: queue what the server sends to the virtual
+ *  nodes, broadcasts too (those go on to games.c as well)
+ */
+int loadgen_receive( const lownet_frame_t *frame )
+{
+    int mine;
+
+    if ( !running || frame->source != conf.server )
+        return 0;
+    mine = frame->destination >= LOADGEN_FIRST &&
+           frame->destination - LOADGEN_FIRST < conf.players;
+    if ( (mine || frame->destination == GAME_BROADCAST) &&
+         xQueueSend( inbox, frame, 0 ) != pdTRUE )
+        st.dropped++;
+    return mine;
+}
+
+#else  /* LOADGEN_HOST */
+
+/*
+ *  A model of the server: pairs the registrations in order and plays
+ *  the games on its own boards, full status after every move.  Each
+ *  frame is delivered after a random latency of SIM_LATENCY_MS at most.
+ */
+#define SIM_SERVER        0xf0
+#define SIM_LATENCY_MS       8
+#define SIM_FRAMES        1024
+#define SIM_GAMES   (LOADGEN_PLAYERS/2)
+
+typedef struct
+{
+    uint64_t        at;
+    lownet_frame_t  f;
+} sim_event_t;
+
+typedef struct
+{
+    uint32_t     seq;       // 0 = free
+    uint32_t     round;
+    uint8_t      node_1;
+    uint8_t      node_2;
+    tictactoe_t  board;
+} sim_game_t;
+
+static uint64_t     sim_time;
+static sim_event_t  sim_q[ SIM_FRAMES ];
+static int          sim_n;
+static sim_game_t   sim_games[ SIM_GAMES ];
+static uint32_t     sim_seq;
+static uint8_t      sim_waiting;
+
+static uint64_t lg_now( void )
+{
+    return sim_time;
+}
+
+static uint32_t lg_random( void )
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+static void lg_send( lownet_frame_t *f )
+{
+    if ( sim_n == SIM_FRAMES )
+    {
+        st.dropped++;
+        return;
+    }
+    sim_q[ sim_n ].at = sim_time + 1 + lg_random() % SIM_LATENCY_MS;
+    sim_q[ sim_n ].f  = *f;
+    sim_n++;
+}
+
+static void lg_line( const char *s )
+{
+    puts( s );
+}
+
+static void sim_reply( uint8_t dest, const void *msg, int len )
+{
+    lownet_frame_t f;
+
+    memset( &f, 0, sizeof(f) );
+    f.source      = SIM_SERVER;
+    f.destination = dest;
+    f.protocol    = LOWNET_PROTOCOL_GAME;
+    f.length      = len;
+    memcpy( f.payload, msg, len );
+    lg_send( &f );
+}
+
+static void sim_status( sim_game_t *g, uint8_t type )
+{
+    uint8_t        buf[ LOWNET_PAYLOAD_SIZE ];
+    game_status_t *gs = (game_status_t *)buf;
+
+    gs->type   = type;
+    gs->game   = GAME_TICTACTOE;
+    gs->seq    = g->seq;
+    gs->round  = g->round;
+    gs->node_1 = g->node_1;
+    gs->node_2 = g->node_2;
+    tictac_encode( &g->board, (tictactoe_payload_t *)&buf[ GAME_STATUS_HEADER ] );
+    sim_reply( GAME_BROADCAST, buf, GAME_STATUS_HEADER + TICTACTOE_N3 );
+}
+
+static void sim_register( uint8_t node, const game_register_t *r )
+{
+    game_register_t ack = *r;
+    sim_game_t     *g   = NULL;
+
+    for( int i=0; i<SIM_GAMES && !g; i++ )
+        if ( !sim_games[i].seq )
+            g = &sim_games[i];
+    ack.flags = g || !sim_waiting ? GAME_ACK : GAME_NACK;
+    sim_reply( node, &ack, sizeof(ack) );
+    if ( ack.flags == GAME_NACK || sim_waiting == node )
+        return;
+    if ( !sim_waiting )
+    {
+        sim_waiting = node;
+        return;
+    }
+    memset( g, 0, sizeof(sim_game_t) );
+    g->seq      = ++sim_seq;
+    g->round    = 1;
+    g->node_1   = sim_waiting;
+    g->node_2   = node;
+    sim_waiting = 0;
+    sim_status( g, GAME_PACKET_STATUS );
+}
+
+static void sim_action( const game_action_t *ga )
+{
+    game_action_t reply = *ga;
+    sim_game_t   *g     = NULL;
+    int           res;
+
+    for( int i=0; i<SIM_GAMES && !g; i++ )
+        if ( sim_games[i].seq && sim_games[i].seq == ga->seq )
+            g = &sim_games[i];
+    if ( !g )
+        return;
+    if ( ga->type == GAME_PACKET_RESYNC )
+    {
+        sim_status( g, GAME_PACKET_STATUS );
+        return;
+    }
+    reply.flags = ga->node != ((g->round & 1) ? g->node_1 : g->node_2) ||
+                  tictac_set( &g->board, ga->move_x, ga->move_y, 2 - (g->round & 1) )
+                  ? GAME_NACK : GAME_ACK;
+    sim_reply( ga->node, &reply, sizeof(reply) );
+    if ( reply.flags == GAME_NACK )
+        return;
+    g->round++;
+    res = tictac_check_move( &g->board, ga->move_x, ga->move_y );
+    if ( res || g->round > TICTACTOE_N )
+    {
+        sim_status( g, res==1 ? GAME_PACKET_WINNER_1 : res==2 ? GAME_PACKET_WINNER_2 : GAME_PACKET_TIE );
+        g->seq = 0;
+    }
+    else
+        sim_status( g, GAME_PACKET_STATUS );
+}
+
+static void sim_deliver( const lownet_frame_t *f )
+{
+    const game_msg_header_t *h = (const game_msg_header_t *)f->payload;
+
+    if ( f->source != SIM_SERVER )
+    {
+        if ( h->type == GAME_PACKET_REGISTER )
+            sim_register( f->source, (const game_register_t *)f->payload );
+        else if ( h->type == GAME_PACKET_ACTION || h->type == GAME_PACKET_RESYNC )
+            sim_action( (const game_action_t *)f->payload );
+        return;
+    }
+    lg_frame( f, lg_now() );
+}
+
+/*
+ *  loadgen [players [think_ms [fixed|uniform|exp [seconds]]]]
+ */
+int main( int argc, char **argv )
+{
+    loadgen_conf_t c   = { SIM_SERVER, 32, LOADGEN_EXP, 200 };
+    uint64_t       end = 60000;
+
+    if ( argc > 1 )
+    {
+        int n = atoi( argv[1] );
+        c.players  = n > 0 && n <= LOADGEN_PLAYERS ? n : 0;   // lg_init() refuses 0
+    }
+    if ( argc > 2 )
+        c.think_ms = atoi( argv[2] );
+    if ( argc > 3 )
+        c.dist     = !strcmp( argv[3], "fixed" ) ? LOADGEN_FIXED :
+                     !strcmp( argv[3], "uniform" ) ? LOADGEN_UNIFORM : LOADGEN_EXP;
+    if ( argc > 4 )
+        end        = 1000ull*atoi( argv[4] );
+
+    if ( lg_init( &c, 0 ) )
+    {
+        printf( "At most %d players\n", LOADGEN_PLAYERS );
+        return -1;
+    }
+    while ( sim_time < end )
+    {
+        uint64_t next = lg_tick( sim_time );
+        int      k    = -1;
+
+        for( int i=0; i<sim_n; i++ )
+            if ( k < 0 || sim_q[i].at < sim_q[k].at )
+                k = i;
+        if ( k >= 0 && sim_q[k].at <= next )
+        {
+            lownet_frame_t f = sim_q[k].f;
+
+            sim_time = sim_q[k].at;
+            sim_q[k] = sim_q[ --sim_n ];
+            sim_deliver( &f );
+        }
+        else
+            sim_time = next;
+    }
+    st.t_now = sim_time;
+    lg_report();
+    return 0;
+}
+
+#endif
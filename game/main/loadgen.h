@@ -0,0 +1,67 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <stdint.h>
+
+#include "lownet.h"
+
+/*
+ *  Synthetic clients for load testing a game server
+ *
+ *  Virtual player nodes LOADGEN_FIRST.. speak the games.c client
+ *  protocol against a real server: register, wait for a game, play
+ *  tictac_auto() moves after a think time and register again when the
+ *  game is over.  Frames go out with the virtual node as the source
+ *  and lownet_ext_accept() lets the replies in.
+ *
+ *  The report has games/s, moves/s, the round trip of a move (action
+ *  to ACK) as percentiles, the NACKs and the games lost by a timeout.
+ *
+ *  Compile with -DLOADGEN_HOST for a host binary that runs the same
+ *  clients against a model of the server:
+ *
+ *    gcc -Wall -DLOADGEN_HOST -I. -o loadgen loadgen.c tictactoe.c tictac_node.c tictac_search.c tictac_eval.c tictac_frontier.c tictac_mcts.c tictac_book.c -lm
+ */
+
+#define LOADGEN_PLAYERS     64    // at most
+#define LOADGEN_FIRST     0xa0    // first virtual node id, keep clear of real nodes
+#define LOADGEN_RTT_BIN      2    // ms per histogram bin
+#define LOADGEN_RTT_BINS   512    // ..and one more for the rest
+
+#define LOADGEN_FIXED        0    // think time distributions
+#define LOADGEN_UNIFORM      1    // 0 .. 2*mean
+#define LOADGEN_EXP          2    // exponential
+
+typedef struct
+{
+    uint8_t   server;
+    uint8_t   players;
+    uint8_t   dist;       // LOADGEN_xyz
+    uint32_t  think_ms;   // mean
+} loadgen_conf_t;
+
+typedef struct
+{
+    uint64_t  t_start;
+    uint64_t  t_now;
+    uint32_t  registers;
+    uint32_t  reg_nacks;
+    uint32_t  games;      // started
+    uint32_t  over;       // ..and finished
+    uint32_t  ties;
+    uint32_t  forfeits;   // game over without five in a row
+    uint32_t  moves;
+    uint32_t  move_nacks;
+    uint32_t  lost;       // moves without a reply
+    uint32_t  resyncs;
+    uint32_t  dropped;    // frames that did not fit the inbox
+    uint32_t  rtt_max;
+    uint32_t  rtt[ LOADGEN_RTT_BINS + 1 ];
+} loadgen_stats_t;
+
+int  loadgen_start( const loadgen_conf_t *c );
+void loadgen_stop( void );
+int  loadgen_report( void );                          // to serial
+int  loadgen_receive( const lownet_frame_t *frame );  // 1 if it was for a virtual node
+
+#endif
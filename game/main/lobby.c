@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lobby.h"
+
+#define LEAVE_COST     10000   // > any rating difference: pair as many as we can
+#define OVERDUE_COST   40000   // ..and rather leave out someone who can wait
+
+int lobby_add( lobby_t *L, uint8_t node, uint16_t rating, uint64_t now )
+{
+    for( int i=0; i<L->n; i++ )
+        if ( L->e[i].node == node )
+            return 1;
+    if ( L->n >= LOBBY_MAX )
+        return -1;
+
+    /* keep sorted by rating, pairing works on neighbours */
+    int i = L->n++;
+    while ( i > 0 && L->e[i-1].rating > rating )
+    {
+        L->e[i] = L->e[i-1];
+        i--;
+    }
+    L->e[i].node   = node;
+    L->e[i].rating = rating;
+    L->e[i].since  = now;
+
+    if ( !L->round )
+        L->round = now + LOBBY_BATCH_MS;
+    return 0;
+}
+
+int lobby_remove( lobby_t *L, uint8_t node )
+{
+    for( int i=0; i<L->n; i++ )
+    {
+        if ( L->e[i].node == node )
+        {
+            memmove( L->e + i, L->e + i + 1, (L->n - i - 1)*sizeof(lobby_entry_t) );
+            L->n--;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int overdue( const lobby_entry_t *a, uint64_t now )
+{
+    return a->since + LOBBY_MAX_WAIT <= now;
+}
+
+static int allowed( const lobby_entry_t *a, const lobby_entry_t *b, uint64_t now )
+{
+    uint64_t first = a->since < b->since ? a->since : b->since;
+    uint32_t diff  = b->rating - a->rating;   // sorted, b >= a
+
+    if ( overdue( a, now ) || overdue( b, now ) )
+        return 1;
+    return diff <= LOBBY_DIFF + (uint32_t)((now - first) * LOBBY_DIFF_PER_S / 1000);
+}
+
+/*
+ *  Minimum cost matching over the rating-sorted list:
+ *  pairing the neighbours i-1,i costs their rating difference,
+ *  leaving a player out costs LEAVE_COST (OVERDUE_COST if overdue).
+ *  With a sorted list the optimum only pairs neighbours, so one
+ *  pass of dynamic programming does it.
+ */
+int lobby_pair( lobby_t *L, uint64_t now, lobby_pair_t *pairs, int max )
+{
+    int32_t cost[ LOBBY_MAX+1 ];
+    uint8_t take[ LOBBY_MAX+1 ];  // 1: i-1 and i-2 paired
+    int     made = 0;
+
+    L->round = 0;
+    if ( L->n < 2 )
+        return 0;
+
+    cost[0] = 0;
+    for( int i=1; i<=L->n; i++ )
+    {
+        const lobby_entry_t *b = L->e + i - 1;
+        
+        cost[i] = cost[i-1] + (overdue( b, now ) ? OVERDUE_COST : LEAVE_COST);
+        take[i] = 0;
+        if ( i >= 2 && allowed( b - 1, b, now ) )
+        {
+            int32_t c = cost[i-2] + (b->rating - (b-1)->rating);
+            if ( c < cost[i] )
+            {
+                cost[i] = c;
+                take[i] = 1;
+            }
+        }
+    }
+
+    /* walk back, mark the paired ones */
+    uint8_t paired[ LOBBY_MAX ];
+    memset( paired, 0, sizeof(paired) );
+    for( int i=L->n; i>=2; )
+    {
+        if ( take[i] && made < max )
+        {
+            pairs[made].node_1 = L->e[i-2].node;
+            pairs[made].node_2 = L->e[i-1].node;
+            paired[i-2] = paired[i-1] = 1;
+            made++;
+            i -= 2;
+        }
+        else
+            i--;
+    }
+
+    /* compact the leftovers, still sorted */
+    int k = 0;
+    for( int i=0; i<L->n; i++ )
+        if ( !paired[i] )
+            L->e[k++] = L->e[i];
+    L->n = k;
+    
+    if ( L->n >= 2 )
+        L->round = now + LOBBY_RETRY_MS;
+    return made;
+}
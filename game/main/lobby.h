@@ -0,0 +1,46 @@
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#include <stdint.h>
+
+/*
+ *  Matchmaking lobby of the game server
+ *
+ *  Registered players wait here with their rating.  lobby_pair()
+ *  pairs everybody it can in one go, keeping the rating differences
+ *  small; the difference allowed grows with the waiting time and a
+ *  player overdue (LOBBY_MAX_WAIT) is paired with anyone.
+ */
+
+#define LOBBY_MAX            64
+#define LOBBY_BATCH_MS      250   // collect registrations this long before pairing
+#define LOBBY_RETRY_MS     1000   // re-pair leftovers this often
+#define LOBBY_MAX_WAIT     5000   // ms, after that any opponent will do
+#define LOBBY_DIFF          100   // rating difference allowed right away
+#define LOBBY_DIFF_PER_S    100   // ..and more for each second waited
+
+typedef struct
+{
+    uint64_t  since;    // registration time, ms
+    uint16_t  rating;
+    uint8_t   node;
+} lobby_entry_t;
+
+typedef struct
+{
+    uint8_t   node_1;
+    uint8_t   node_2;
+} lobby_pair_t;
+
+typedef struct
+{
+    lobby_entry_t  e[ LOBBY_MAX ];
+    int            n;
+    uint64_t       round;   // next pairing round, ms; 0 = none due
+} lobby_t;
+
+int  lobby_add(    lobby_t *L, uint8_t node, uint16_t rating, uint64_t now );  // 0 added, 1 already there, -1 full
+int  lobby_remove( lobby_t *L, uint8_t node );
+int  lobby_pair(   lobby_t *L, uint64_t now, lobby_pair_t *pairs, int max );  // number of pairs made
+
+#endif
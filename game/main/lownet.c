@@ -195,6 +195,16 @@ void lownet_ext_send(const lownet_frame_t* frame) {
 	}
 }
 
+// Extra destinations accepted besides our own identity and broadcast.
+static volatile uint8_t ext_first = 0;
+static volatile uint8_t ext_count = 0;
+
+void lownet_ext_accept(uint8_t first, uint8_t count) {
+	ext_count = 0;
+	ext_first = first;
+	ext_count = count;
+}
+
 // Public interface; standard send.  Delegate to encrypt-and-send method if AES encryption
 //	key is defined.
 void lownet_send(const lownet_frame_t* frame) {
@@ -354,7 +364,8 @@ void lownet_service_main(void* pvTaskParam) {
 			if (frame.source == 0xFF) { continue; }
 
 			// Check whether packet destination is us or broadcast.
-			if (frame.destination != net_system.identity.node && frame.destination != net_system.broadcast.node)  { continue; }
+			if (frame.destination != net_system.identity.node && frame.destination != net_system.broadcast.node
+				&& (uint8_t)(frame.destination - ext_first) >= ext_count)  { continue; }
 
 			// Mask the signing bits before switching on protocol.
 			switch(frame.protocol & 0b00111111) {
@@ -71,6 +71,9 @@ void lownet_send(const lownet_frame_t* frame);
 void lownet_ext_bake(lownet_frame_t* frame);
 void lownet_ext_send(const lownet_frame_t* frame);
 
+// Also accept frames addressed to nodes first .. first+count-1 (virtual nodes); count 0 stops.
+void lownet_ext_accept(uint8_t first, uint8_t count);
+
 
 lownet_time_t	lownet_get_time();
 void 			lownet_set_time(const lownet_time_t* time);
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <esp_log.h>
+#include <nvs.h>
+
+#include "rating.h"
+
+#define TAG "rating.c"
+
+/*
+ * "Elo formula":
+ *
+ *  r' = r + k*(s-e)
+ *
+ *  k = "learning rate", 32
+ *  s = outcome, (win=1, loss=0, tie=1/2)
+ *  e = expected outcome = qa/(qa+qb), qi=10^(ri/c)
+ *      where c=400
+ *  r_init = 1500
+ *  r_min  = 1000
+ */
+
+static uint16_t  rating[256];
+static uint16_t  played[256];
+static uint8_t   order[256];     // rated nodes, best first
+static uint8_t   pos[256];       // node's index in order[]
+static int       ranked = 0;     // nodes in order[]
+
+static int       dirty  = 0;     // changes not in NVS yet
+static uint64_t  due    = 0;     // when they go there
+
+/*
+ *  Published top of the ranking, double buffered: the home shard
+ *  fills the spare copy and then bumps the version.  Readers retry
+ *  only if a new version came out while they were copying.
+ */
+static rating_top_t       tops[2];
+static volatile uint32_t  top_version = 0;
+
+/********************************************************************************/
+
+static void publish( void )
+{
+    rating_top_t t;
+
+    t.count = ranked < GAME_LEADERS ? ranked : GAME_LEADERS;
+    for( int i=0; i<t.count; i++ )
+    {
+        uint8_t n = order[i];
+        t.leader[i].node   = n;
+        t.leader[i].rating = rating[n];
+        t.leader[i].games  = played[n];
+    }
+    tops[ (top_version + 1) & 1 ] = t;
+    __sync_synchronize();
+    top_version++;
+}
+
+/*
+ *  Move a node to its place after its rating changed, a few swaps
+ *  at most for one game.  Returns the lowest index touched.
+ */
+static int rank_move( uint8_t node )
+{
+    int i, from;
+
+    if ( !played[node] )
+    {
+        pos[node] = ranked;
+        order[ranked++] = node;
+    }
+    i = from = pos[node];
+
+    while ( i > 0 && rating[ order[i-1] ] < rating[node] )
+    {
+        order[i] = order[i-1];
+        pos[ order[i] ] = i;
+        i--;
+    }
+    while ( i < ranked-1 && rating[ order[i+1] ] > rating[node] )
+    {
+        order[i] = order[i+1];
+        pos[ order[i] ] = i;
+        i++;
+    }
+    order[i]  = node;
+    pos[node] = i;
+    return i < from ? i : from;
+}
+
+/********************************************************************************/
+
+int rating_init( void )
+{
+    static game_leader_t saved[256];
+    size_t       len = sizeof(saved);
+    nvs_handle_t nvs;
+
+    for( int i=0; i<256; i++ )
+        rating[i] = RATING_INIT;
+
+    if ( nvs_open( RATING_NAMESPACE, NVS_READONLY, &nvs ) != ESP_OK )
+        return 0;
+    if ( nvs_get_blob( nvs, "table", saved, &len ) == ESP_OK )
+    {
+        for( int i=0; i < len/sizeof(game_leader_t); i++ )
+        {
+            uint8_t n = saved[i].node;
+            if ( played[n] )
+                continue;
+            rating[n] = saved[i].rating;
+            rank_move( n );
+            played[n] = saved[i].games ? saved[i].games : 1;
+        }
+    }
+    nvs_close( nvs );
+    publish();
+    ESP_LOGI(TAG, "%d ratings loaded", ranked );
+    return ranked;
+}
+
+uint16_t rating_get( uint8_t node )
+{
+    return rating[node];
+}
+
+void rating_result( uint8_t winner, uint8_t loser, int tie )
+{
+    float  e  = 1.0f / ( 1.0f + powf( 10.0f, ((float)rating[loser] - rating[winner]) / RATING_C ) );
+    float  s  = tie ? 0.5f : 1.0f;
+    int    d  = lroundf( RATING_K * (s - e) );
+    int    rw = rating[winner] + d;
+    int    rl = rating[loser]  - d;
+    int    a, b;
+
+    if ( winner == loser )   // self-play, nothing to learn
+        return;
+
+    rating[winner] = rw < RATING_MIN ? RATING_MIN : rw;
+    rating[loser]  = rl < RATING_MIN ? RATING_MIN : rl;
+    a = rank_move( winner );
+    b = rank_move( loser );
+    played[winner]++;
+    played[loser]++;
+    dirty = 1;
+
+    if ( a < GAME_LEADERS || b < GAME_LEADERS )
+        publish();
+}
+
+/*
+ *  Everything in one blob, only when something changed and the
+ *  batch window is over (or forced).
+ */
+uint64_t rating_flush( uint64_t now, int force )
+{
+    static game_leader_t buf[256];
+    nvs_handle_t nvs;
+    esp_err_t    err;
+
+    if ( !dirty )
+        return 0;
+    if ( !due )
+        due = now + RATING_FLUSH_MS;
+    if ( !force && now < due )
+        return due;
+
+    for( int i=0; i<ranked; i++ )
+    {
+        uint8_t n = order[i];
+        buf[i].node   = n;
+        buf[i].rating = rating[n];
+        buf[i].games  = played[n];
+    }
+    err = nvs_open( RATING_NAMESPACE, NVS_READWRITE, &nvs );
+    if ( err == ESP_OK )
+    {
+        err = nvs_set_blob( nvs, "table", buf, ranked*sizeof(game_leader_t) );
+        if ( err == ESP_OK )
+            err = nvs_commit( nvs );
+        nvs_close( nvs );
+    }
+    if ( err != ESP_OK )
+    {
+        ESP_LOGW(TAG, "ratings not saved (%d), retry later", (int)err );
+        due = now + RATING_FLUSH_MS;
+        return due;
+    }
+    dirty = 0;
+    due   = 0;
+    return 0;
+}
+
+void rating_top( rating_top_t *t )
+{
+    uint32_t v;
+
+    do {
+        v = top_version;
+        __sync_synchronize();
+        *t = tops[ v & 1 ];
+        __sync_synchronize();
+    } while ( v != top_version );
+}
@@ -0,0 +1,36 @@
+#ifndef RATING_H
+#define RATING_H
+
+#include <stdint.h>
+
+#include "games.h"
+
+/*
+ *  Elo ratings of the game server
+ *
+ *  Updated by the home shard of the server only.  The top of the
+ *  ranking is kept in order as results come in and published as a
+ *  snapshot that any task can read without locks.  Ratings go to NVS in batches, at
+ *  most once per RATING_FLUSH_MS.
+ */
+
+#define RATING_INIT      1500
+#define RATING_MIN       1000
+#define RATING_K           32   // "learning rate"
+#define RATING_C          400
+#define RATING_FLUSH_MS 60000
+#define RATING_NAMESPACE "ratings"
+
+typedef struct
+{
+    uint8_t        count;
+    game_leader_t  leader[GAME_LEADERS];
+} rating_top_t;
+
+int      rating_init(   void );                                    // load from NVS
+uint16_t rating_get(    uint8_t node );
+void     rating_result( uint8_t winner, uint8_t loser, int tie );  // home shard only
+uint64_t rating_flush(  uint64_t now, int force );                 // next flush due, 0 = nothing to write
+void     rating_top(    rating_top_t *top );                       // snapshot, never blocks
+
+#endif
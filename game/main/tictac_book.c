@@ -0,0 +1,389 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_random.h>
+#else
+#include <stdlib.h>
+#endif
+
+#include "tictactoe.h"
+#include "tictac_book.h"
+
+#define TAG "tictac_book.c"
+
+#define N  TICTACTOE_BOARD
+
+static const book_entry_t *book = 0;   // no book if 0
+static uint32_t            book_n;
+
+/*
+ *  Symmetry t of the board: bit 0 mirrors x, bit 1 mirrors y, bit 2
+ *  then swaps them; unfolding does it the other way round
+ */
+int tictac_book_fold( int t, int p )
+{
+    int x = p % N, y = p / N;
+
+    if ( t & 1 ) x = N-1 - x;
+    if ( t & 2 ) y = N-1 - y;
+    if ( t & 4 ) { int z = x; x = y; y = z; }
+    return x + N*y;
+}
+
+int tictac_book_unfold( int t, int p )
+{
+    int x = p % N, y = p / N;
+
+    if ( t & 4 ) { int z = x; x = y; y = z; }
+    if ( t & 1 ) x = N-1 - x;
+    if ( t & 2 ) y = N-1 - y;
+    return x + N*y;
+}
+
+/* 64-bit Zobrist value of a stone: the digest's, and a mix of it on top */
+static uint64_t zobrist( int p, uint8_t s )
+{
+    uint32_t lo = tictac_dcell( p % N, p / N, s );
+    uint32_t hi = lo ^ 0x5bd1e995u;
+
+    hi ^= hi >> 15;  hi *= 0x2c1b3c6du;
+    hi ^= hi >> 12;  hi *= 0x297a2d39u;
+    hi ^= hi >> 15;
+    return (uint64_t)hi << 32 | lo;
+}
+
+int tictac_book_key( const tictactoe_t *b, uint64_t *key )
+{
+    uint16_t sq[ BOOK_PLIES ];
+    uint8_t  side[ BOOK_PLIES ];
+    int      n = 0, best = 0;
+
+    for( int s=0; s<2; s++ )
+        for( int w=0; w<TICTACTOE_WORDS; w++ )
+            for( uint64_t m = b->bits[s][w]; m; m &= m-1 )
+            {
+                int q = 64*w + __builtin_ctzll( m );
+                if ( n == BOOK_PLIES )
+                    return -1;                       // past the book
+                sq[n]     = q % TICTACTOE_STRIDE + N * (q / TICTACTOE_STRIDE);
+                side[n++] = s+1;
+            }
+
+    for( int t=0; t<8; t++ )
+    {
+        uint64_t k = 0;
+        for( int i=0; i<n; i++ )
+            k ^= zobrist( tictac_book_fold( t, sq[i] ), side[i] );
+        if ( !t || k < *key )
+        {
+            *key = k;
+            best = t;
+        }
+    }
+    return best;
+}
+
+int tictac_book_set( const void *data, size_t len )
+{
+    const book_header_t *h = data;
+
+    if ( !data || len < sizeof(book_header_t) || h->magic != BOOK_MAGIC ||
+         h->count > (len - sizeof(book_header_t)) / sizeof(book_entry_t) )
+    {
+        book = 0;
+        return -1;
+    }
+    book   = (const book_entry_t *)(h + 1);
+    book_n = h->count;
+    return 0;
+}
+
+#ifdef ESP_PLATFORM
+
+int tictac_book_init( void )
+{
+    static esp_partition_mmap_handle_t  handle;
+    const esp_partition_t              *part;
+    const void                         *data;
+
+    part = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BOOK_PARTITION );
+    if ( !part )
+    {
+        ESP_LOGW(TAG, "no book partition, the engines open by themselves" );
+        return -1;
+    }
+    if ( esp_partition_mmap( part, 0, part->size, ESP_PARTITION_MMAP_DATA, &data, &handle ) != ESP_OK )
+    {
+        ESP_LOGE(TAG, "cannot map the book" );
+        return -1;
+    }
+    if ( tictac_book_set( data, part->size ) )
+    {
+        ESP_LOGW(TAG, "book partition is empty" );
+        esp_partition_munmap( handle );
+        return -1;
+    }
+    ESP_LOGI(TAG, "book of %lu moves", (unsigned long)book_n );
+    return 0;
+}
+
+#endif
+
+/*
+ *  A move of the book for b, picked at random by weight: 0 and (x,y),
+ *  -1 if the position is not in the book
+ */
+int tictac_book_move( const tictactoe_t *b, int *x, int *y )
+{
+    uint64_t key;
+    uint32_t lo = 0, hi, total = 0, r;
+    int      t, p;
+
+    if ( !book || (t = tictac_book_key( b, &key )) < 0 )
+        return -1;
+
+    hi = book_n;
+    while ( lo < hi )                  // first entry of key
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ( book[mid].key < key )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for( hi = lo; hi < book_n && book[hi].key == key; hi++ )
+        total += book[hi].weight;
+    if ( !total )
+        return -1;
+
+#ifdef ESP_PLATFORM
+    r = esp_random() % total;
+#else
+    r = rand() % total;
+#endif
+    while ( r >= book[lo].weight )
+        r -= book[lo++].weight;
+
+    p = tictac_book_unfold( t, book[lo].move );
+    if ( book[lo].move >= TICTACTOE_N || tictac_get( b, p % N, p / N ) )
+        return -1;                     // a key that collided
+    *x = p % N;
+    *y = p / N;
+    return 0;
+}
+
+/********************************************************************************/
+
+#ifdef BOOK_HOST
+
+#include "tictac_search.h"
+
+#define GAME_TICTACTOE   0x01   // as in games.h
+#define STATE_ONE_WON    2      // ..and gameserver.c
+#define STATE_TWO_WON    3
+#define STATE_TIE        4
+
+static book_entry_t *out;
+static size_t        nout, cap;
+
+/* the move p of s on b, weighted by how the game went for s */
+static void add( const tictactoe_t *b, int p, uint8_t s, int winner )
+{
+    uint64_t key;
+    int      t = tictac_book_key( b, &key );
+    int      w = winner == s ? 2 : winner == 0 ? 1 : 0;
+
+    if ( t < 0 || !w )
+        return;
+    if ( nout == cap )
+    {
+        cap = cap ? 2*cap : 4096;
+        out = realloc( out, cap * sizeof(book_entry_t) );
+    }
+    out[ nout ].key    = key;
+    out[ nout ].move   = tictac_book_fold( t, p );
+    out[ nout++ ].weight = w;
+}
+
+/* the first BOOK_PLIES moves of a game, crosses first */
+static void add_game( const uint16_t *moves, int n, int winner )
+{
+    tictactoe_t b;
+
+    memset( &b, 0, sizeof(b) );
+    for( int k=0; k<n && k<BOOK_PLIES; k++ )
+    {
+        uint8_t s = 1 + (k & 1);
+        add( &b, moves[k], s, winner );
+        if ( tictac_set( &b, moves[k] % N, moves[k] / N, s ) )
+            return;
+    }
+}
+
+/*
+ *  Self-play of the search; a third of the book moves are at random
+ *  next to the stones so the openings differ
+ */
+static int from_play( int games, int ms )
+{
+    for( int g=0; g<games; g++ )
+    {
+        tictactoe_t b;
+        uint16_t    moves[ BOOK_PLIES ];
+        int         res = 0, x, y, k;
+
+        memset( &b, 0, sizeof(b) );
+        for( k=0; k<TICTACTOE_N && !res; k++ )
+        {
+            uint8_t  s = 1 + (k & 1);
+            uint64_t m[ TICTACTOE_WORDS ];
+
+            if ( !k )
+            {
+                x = N/2 - 2 + rand() % 5;
+                y = N/2 - 2 + rand() % 5;
+            }
+            else if ( k < BOOK_PLIES && !(rand() % 3) )
+            {
+                int r = rand() % tictac_near( &b, 1, m ), w = 0;
+                while ( r >= __builtin_popcountll( m[w] ) )
+                    r -= __builtin_popcountll( m[w++] );
+                while ( r-- )
+                    m[w] &= m[w]-1;
+                int q = 64*w + __builtin_ctzll( m[w] );
+                x = q % TICTACTOE_STRIDE;
+                y = q / TICTACTOE_STRIDE;
+            }
+            else if ( tictac_search( &b, &x, &y, s, ms, NULL ) )
+                break;
+            if ( k < BOOK_PLIES )
+                moves[k] = x + N*y;
+            tictac_set( &b, x, y, s );
+            res = tictac_check_move( &b, x, y );
+        }
+        add_game( moves, k < BOOK_PLIES ? k : BOOK_PLIES, res );
+        fprintf( stderr, "\rgame %d/%d", g+1, games );
+    }
+    fprintf( stderr, "\n" );
+    return games;
+}
+
+/*
+ *  Tic-tac-toe games of a journal export: seq,start,node_1,node_2,game
+ *  then seq,move,round,x,y and seq,result,state.  Round r is a move of
+ *  player 2 - (r & 1).
+ */
+typedef struct
+{
+    uint32_t  seq;
+    uint16_t  moves[ BOOK_PLIES ];
+    uint16_t  have;      // bit k: move of round k+1 seen
+    uint8_t   game;
+    uint8_t   state;
+} jgame_t;
+
+static int from_journal( FILE *f )
+{
+    static jgame_t  g[ 4096 ];
+    int             ng = 0, used = 0;
+    char            line[ 128 ], ev[ 16 ];
+    unsigned long   seq;
+    unsigned        a, b, c;
+
+    while ( fgets( line, sizeof(line), f ) )
+    {
+        int i, n = sscanf( line, "%lu,%15[a-z],%i,%i,%i", &seq, ev, &a, &b, &c );
+        if ( n < 3 )
+            continue;
+        for( i=ng-1; i>=0 && g[i].seq != seq; i-- )
+            ;
+        if ( i < 0 )
+        {
+            if ( ng == sizeof(g)/sizeof(g[0]) )
+                continue;
+            i = ng++;
+            memset( &g[i], 0, sizeof(jgame_t) );
+            g[i].seq = seq;
+        }
+        if ( !strcmp( ev, "start" ) && n == 5 )
+            g[i].game = c;
+        else if ( !strcmp( ev, "move" ) && n == 5 && a >= 1 && a <= BOOK_PLIES && b < N && c < N )
+        {
+            g[i].moves[a-1] = b + N*c;
+            g[i].have |= 1 << (a-1);
+        }
+        else if ( !strcmp( ev, "result" ) )
+            g[i].state = a;
+    }
+
+    for( int i=0; i<ng; i++ )
+    {
+        int n = 0;
+        if ( g[i].game != GAME_TICTACTOE ||
+             (g[i].state != STATE_ONE_WON && g[i].state != STATE_TWO_WON && g[i].state != STATE_TIE) )
+            continue;
+        while ( n < BOOK_PLIES && (g[i].have & (1 << n)) )
+            n++;
+        add_game( g[i].moves, n, g[i].state == STATE_TIE ? 0 : g[i].state - 1 );
+        used++;
+    }
+    return used;
+}
+
+static int entry_cmp( const void *a, const void *b )
+{
+    const book_entry_t *p = a, *q = b;
+    if ( p->key != q->key )
+        return p->key < q->key ? -1 : 1;
+    return (int)p->move - (int)q->move;
+}
+
+/*
+ *  ./book play [games [ms]]   or   ./book journal < export.csv
+ *
+ *  Writes the book to stdout, the same moves of a position merged.
+ */
+int main( int argc, char **argv )
+{
+    book_header_t h = { BOOK_MAGIC, 0, { 0, 0 } };
+    size_t        n = 0, keys = 0;
+    int           games;
+
+    srand( 1 );
+    if ( argc > 1 && !strcmp( argv[1], "play" ) )
+        games = from_play( argc > 2 ? atoi( argv[2] ) : 100, argc > 3 ? atoi( argv[3] ) : 100 );
+    else if ( argc > 1 && !strcmp( argv[1], "journal" ) )
+        games = from_journal( stdin );
+    else
+    {
+        fprintf( stderr, "usage: %s play [games [ms]] | journal < export.csv\n", argv[0] );
+        return 1;
+    }
+
+    qsort( out, nout, sizeof(book_entry_t), entry_cmp );
+    for( size_t i=0; i<nout; i++ )
+    {
+        if ( n && out[n-1].key == out[i].key && out[n-1].move == out[i].move )
+        {
+            uint32_t w = out[n-1].weight + out[i].weight;
+            out[n-1].weight = w > 0xffff ? 0xffff : w;
+        }
+        else
+            out[n++] = out[i];
+    }
+    h.count = n;
+    fwrite( &h, sizeof(h), 1, stdout );
+    fwrite( out, sizeof(book_entry_t), n, stdout );
+
+    for( size_t i=0; i<n; i++ )
+        keys += !i || out[i].key != out[i-1].key;
+    fprintf( stderr, "%d games, %zu moves in %zu positions, %zu octets\n", games, n, keys,
+             sizeof(h) + n * sizeof(book_entry_t) );
+    return 0;
+}
+
+#endif
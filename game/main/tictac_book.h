@@ -0,0 +1,55 @@
+#ifndef TICTAC_BOOK_H
+#define TICTAC_BOOK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "tictactoe.h"
+
+/*
+ *  Opening book for five in a row
+ *
+ *  A position is folded to the least key over its 8 symmetric images
+ *  (the 64-bit Zobrist key, XOR over the stones) and maps to weighted
+ *  moves, in the frame of that image.  The book is a header and the
+ *  entries sorted by key, so a lookup is a binary search and then a
+ *  weighted pick among the moves of the key.
+ *
+ *  On the node the book has a flash partition of its own that is
+ *  memory mapped, so it costs no RAM.  The host tool builds one from
+ *  self-play or from a journal export (/journal dump):
+ *
+ *    gcc -Wall -O2 -DBOOK_HOST -I. -o book tictac_book.c tictac_search.c tictac_eval.c tictac_frontier.c tictactoe.c -lm
+ *    ./book play [games [ms]] > book.bin
+ *    ./book journal < export.csv > book.bin
+ *    parttool.py write_partition --partition-name=book --input=book.bin
+ */
+
+#define BOOK_PARTITION  "book"
+#define BOOK_MAGIC      0x4b4f4f42u   // "BOOK"
+#define BOOK_PLIES      8             // stones on the board, at most, for the book
+
+typedef struct __attribute__((packed))
+{
+    uint32_t  magic;
+    uint32_t  count;      // entries that follow
+    uint32_t  reserved[2];
+} book_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint64_t  key;        // of the folded position
+    uint16_t  move;       // x + 30*y, in the folded frame
+    uint16_t  weight;
+} book_entry_t;
+
+int tictac_book_init( void );                          // maps the partition
+int tictac_book_set( const void *data, size_t len );   // ..or a book in memory
+int tictac_book_move( const tictactoe_t *b, int *x, int *y );   // 0 if in the book
+
+/* folded key of b, returns the symmetry that folds it */
+int tictac_book_key( const tictactoe_t *b, uint64_t *key );
+int tictac_book_fold( int t, int p );     // square p into the folded frame
+int tictac_book_unfold( int t, int p );   // ..and back
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tictactoe.h"
+#include "tictac_eval.h"
+
+#define N  TICTACTOE_BOARD
+
+static const int dx[4] = { 1, 0, 1,  1 };
+static const int dy[4] = { 0, 1, 1, -1 };
+
+/* value of a window for crosses, by the stones in it */
+static const int32_t weight[6] = { 0, 1, 12, 120, 1200, 12000 };
+
+static int32_t value( uint8_t w )
+{
+    uint8_t x = w & 15, o = w >> 4;
+    return o ? (x ? 0 : -weight[o]) : weight[x];
+}
+
+/*
+ *  Stone s on or off (x,y): every window through it in each direction,
+ *  those that start on the board and end on it
+ */
+static void update( tictac_eval_t *e, int x, int y, uint8_t s, int on )
+{
+    uint8_t inc = s == 1 ? 1 : 16;
+
+    for( int d=0; d<4; d++ )
+        for( int k=0; k<5; k++ )
+        {
+            int i = x - k*dx[d], j = y - k*dy[d];
+            int i4 = i + 4*dx[d], j4 = j + 4*dy[d];
+
+            if ( i < 0 || i >= N || j < 0 || j >= N ||
+                 i4 < 0 || i4 >= N || j4 < 0 || j4 >= N )
+                continue;
+
+            uint8_t *w   = &e->win[d][ i + N*j ];
+            uint8_t  old = *w;
+
+            *w = on ? old + inc : old - inc;
+            e->score += value( *w ) - value( old );
+            if ( !(old >> 4) != !(old & 15) )       // one side only
+                e->threats[ (old & 15) ? 0 : 1 ][ (old & 15) | (old >> 4) ]--;
+            if ( !(*w >> 4) != !(*w & 15) )
+                e->threats[ (*w & 15) ? 0 : 1 ][ (*w & 15) | (*w >> 4) ]++;
+        }
+}
+
+void tictac_eval_init( tictac_eval_t *e, const tictactoe_t *b )
+{
+    memset( e, 0, sizeof(tictac_eval_t) );
+    for( int j=0; j<N; j++ )
+        for( int i=0; i<N; i++ )
+        {
+            uint8_t s = tictac_get( b, i, j );
+            if ( s )
+                update( e, i, j, s, 1 );
+        }
+}
+
+void tictac_eval_move( tictac_eval_t *e, int x, int y, uint8_t s )
+{
+    update( e, x, y, s, 1 );
+}
+
+void tictac_eval_undo( tictac_eval_t *e, int x, int y, uint8_t s )
+{
+    update( e, x, y, s, 0 );
+}
+
+/*
+ *  Score for s to move: a four of s is five on this move
+ */
+int tictac_eval_score( const tictac_eval_t *e, uint8_t s )
+{
+    if ( e->threats[s-1][ EVAL_FOUR ] )
+        return weight[5];
+    return s == 1 ? e->score : -e->score;
+}
@@ -0,0 +1,39 @@
+#ifndef TICTAC_EVAL_H
+#define TICTAC_EVAL_H
+
+#include <stdint.h>
+
+#include "tictactoe.h"
+
+/*
+ *  Incremental evaluation of a five in a row position
+ *
+ *  Every five squares in a line is a window, kept with the stones of
+ *  both sides in it.  A window with the stones of one side only is a
+ *  threat of that side, by the count: EVAL_TWO..EVAL_FIVE.  A four is
+ *  one move from five, whether solid or broken; an open four is two
+ *  four-windows, an open three two or three three-windows, so the sum
+ *  over the windows ranks open above closed without looking further.
+ *
+ *  A move touches at most 20 windows (5 per direction), so making and
+ *  undoing it costs O(20) and the score is kept up to date: O(1).
+ */
+
+#define EVAL_TWO     2    // stones in a window of one side only
+#define EVAL_THREE   3
+#define EVAL_FOUR    4
+#define EVAL_FIVE    5
+
+typedef struct
+{
+    uint8_t   win[4][ TICTACTOE_N ];  // window from square k in direction d: crosses | circles << 4
+    uint16_t  threats[2][6];          // windows of one side by the stones in them
+    int32_t   score;                  // for crosses
+} tictac_eval_t;
+
+void tictac_eval_init(  tictac_eval_t *e, const tictactoe_t *b );
+void tictac_eval_move(  tictac_eval_t *e, int x, int y, uint8_t s );   // s took (x,y)
+void tictac_eval_undo(  tictac_eval_t *e, int x, int y, uint8_t s );   // ..and takes it back
+int  tictac_eval_score( const tictac_eval_t *e, uint8_t s );            // for s to move
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tictactoe.h"
+#include "tictac_frontier.h"
+
+#define N  TICTACTOE_BOARD
+
+static int bit_of( int x, int y )
+{
+    return x + TICTACTOE_STRIDE*y;
+}
+
+void tictac_frontier_init( tictac_frontier_t *f, const tictactoe_t *b )
+{
+    memset( f, 0, sizeof(tictac_frontier_t) );
+    for( int j=0; j<N; j++ )
+        for( int i=0; i<N; i++ )
+            if ( tictac_get( b, i, j ) )
+                tictac_frontier_move( f, i, j );
+}
+
+void tictac_frontier_move( tictac_frontier_t *f, int x, int y )
+{
+    int q = bit_of( x, y );
+
+    f->occ[ q >> 6 ]   |=   1ull << (q & 63);
+    f->near1[ q >> 6 ] &= ~(1ull << (q & 63));
+    f->near2[ q >> 6 ] &= ~(1ull << (q & 63));
+    for( int j=y-2; j<=y+2; j++ )
+        for( int i=x-2; i<=x+2; i++ )
+        {
+            int      k  = i + N*j;
+            int      p  = bit_of( i, j );
+            int      d1 = i >= x-1 && i <= x+1 && j >= y-1 && j <= y+1;
+            uint64_t m  = 1ull << (p & 63);
+
+            if ( i < 0 || i >= N || j < 0 || j >= N )
+                continue;
+            f->count2[k]++;
+            f->count1[k] += d1;
+            if ( f->occ[ p >> 6 ] & m )
+                continue;
+            f->near2[ p >> 6 ] |= m;
+            if ( d1 )
+                f->near1[ p >> 6 ] |= m;
+        }
+}
+
+void tictac_frontier_undo( tictac_frontier_t *f, int x, int y )
+{
+    int q = bit_of( x, y );
+
+    f->occ[ q >> 6 ] &= ~(1ull << (q & 63));
+    for( int j=y-2; j<=y+2; j++ )
+        for( int i=x-2; i<=x+2; i++ )
+        {
+            int      k  = i + N*j;
+            int      p  = bit_of( i, j );
+            int      d1 = i >= x-1 && i <= x+1 && j >= y-1 && j <= y+1;
+            uint64_t m  = 1ull << (p & 63);
+
+            if ( i < 0 || i >= N || j < 0 || j >= N )
+                continue;
+            f->count2[k]--;
+            f->count1[k] -= d1;
+            if ( f->occ[ p >> 6 ] & m )
+                continue;
+            if ( !f->count2[k] )
+                f->near2[ p >> 6 ] &= ~m;
+            if ( !f->count1[k] )
+                f->near1[ p >> 6 ] &= ~m;
+        }
+    if ( f->count2[ x + N*y ] )   // empty again, and maybe near
+        f->near2[ q >> 6 ] |= 1ull << (q & 63);
+    if ( f->count1[ x + N*y ] )
+        f->near1[ q >> 6 ] |= 1ull << (q & 63);
+}
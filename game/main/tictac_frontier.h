@@ -0,0 +1,31 @@
+#ifndef TICTAC_FRONTIER_H
+#define TICTAC_FRONTIER_H
+
+#include <stdint.h>
+
+#include "tictactoe.h"
+
+/*
+ *  Candidate moves of the engines: the empty squares near a stone
+ *
+ *  A stone adds one to the counts of the 5x5 squares around it (the
+ *  3x3 ones to count1 as well) and marks those that are empty in the
+ *  bitsets, so a move and its takeback cost 25 steps whatever the
+ *  board.  The bitsets are in the bitboard layout, so candidates come
+ *  out a word at a time in row order.
+ */
+
+typedef struct
+{
+    uint64_t  occ[ TICTACTOE_WORDS ];     // the stones, both sides
+    uint64_t  near1[ TICTACTOE_WORDS ];   // empty squares next to a stone
+    uint64_t  near2[ TICTACTOE_WORDS ];   // ..or two away
+    uint8_t   count1[ TICTACTOE_N ];      // stones in the 3x3 around square x + 30*y
+    uint8_t   count2[ TICTACTOE_N ];      // ..and in the 5x5
+} tictac_frontier_t;
+
+void tictac_frontier_init( tictac_frontier_t *f, const tictactoe_t *b );
+void tictac_frontier_move( tictac_frontier_t *f, int x, int y );   // a stone on (x,y)
+void tictac_frontier_undo( tictac_frontier_t *f, int x, int y );   // ..taken back
+
+#endif
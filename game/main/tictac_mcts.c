@@ -0,0 +1,343 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <stdlib.h>
+#include <time.h>
+#endif
+
+#include "tictactoe.h"
+#include "tictac_frontier.h"
+#include "tictac_mcts.h"
+
+#define N  TICTACTOE_BOARD
+
+/*
+ *  A move (square x + 30*y) and what came of it for its player: wins
+ *  in half points, a tie is one.  Children are arena[first..first+n-1].
+ */
+typedef struct
+{
+    uint32_t  visits;
+    uint32_t  wins;
+    uint16_t  move;
+    uint16_t  first;
+    uint8_t   n;
+    uint8_t   done;     // the move made five
+} mcts_node_t;
+
+static mcts_node_t        arena[ MCTS_NODES ];
+static int                used;
+static tictac_frontier_t  fr_root, fr;   // of the root, and of the playout
+static uint32_t           rnd_state = 1;
+
+static uint64_t now_ms( void )
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time() / 1000;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+#endif
+}
+
+static uint32_t rnd( void )   // xorshift32
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+/* square of a random set bit of a mask, -1 if none */
+static int random_square( const uint64_t *m )
+{
+    int n = 0, r;
+
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+        n += __builtin_popcountll( m[w] );
+    if ( !n )
+        return -1;
+    r = rnd() % n;
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+    {
+        int c = __builtin_popcountll( m[w] );
+        if ( r >= c )
+        {
+            r -= c;
+            continue;
+        }
+        uint64_t bits = m[w];
+        while ( r-- )
+            bits &= bits-1;
+        int q = 64*w + __builtin_ctzll( bits );
+        return q % TICTACTOE_STRIDE + N * (q / TICTACTOE_STRIDE);
+    }
+    return -1;
+}
+
+/* s takes square p, in the frontier too */
+static int play( tictactoe_t *b, int p, uint8_t s )
+{
+    tictac_set( b, p % N, p / N, s );
+    tictac_frontier_move( &fr, p % N, p / N );
+    return tictac_check_move( b, p % N, p / N );
+}
+
+/*
+ *  Random moves next to the stones until somebody has five.
+ *  Returns the winner, 0 for a tie.
+ */
+static int playout( tictactoe_t *b, uint8_t s )
+{
+    for( int ply=0; ply<MCTS_PLAYOUT; ply++ )
+    {
+        int p = random_square( fr.near1 );
+        if ( p < 0 )
+            return 0;
+        if ( play( b, p, s ) )
+            return s;
+        s = 3-s;
+    }
+    return 0;
+}
+
+/*
+ *  Children of node: the empty squares next to a stone, those with
+ *  most stones around first.  0 if none or the arena is full.
+ */
+static int expand( int node )
+{
+    uint16_t moves[ MCTS_WIDTH ];
+    uint8_t  val[ MCTS_WIDTH ];
+    int      n = 0;
+
+    if ( used + MCTS_WIDTH > MCTS_NODES )
+        return 0;
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+        for( uint64_t bits = fr.near1[w]; bits; bits &= bits-1 )
+        {
+            int     q = 64*w + __builtin_ctzll( bits );
+            int     x = q % TICTACTOE_STRIDE, y = q / TICTACTOE_STRIDE;
+            uint8_t v = fr.count1[ x + N*y ];
+            int     k = n < MCTS_WIDTH ? n++ : MCTS_WIDTH;
+
+            while ( k > 0 && val[k-1] < v )
+            {
+                if ( k < MCTS_WIDTH )
+                {
+                    moves[k] = moves[k-1];
+                    val[k]   = val[k-1];
+                }
+                k--;
+            }
+            if ( k < MCTS_WIDTH )
+            {
+                moves[k] = x + N*y;
+                val[k]   = v;
+            }
+        }
+
+    arena[node].first = used;
+    arena[node].n     = n;
+    for( int i=0; i<n; i++ )
+    {
+        memset( &arena[used], 0, sizeof(mcts_node_t) );
+        arena[used++].move = moves[i];
+    }
+    return n;
+}
+
+/* UCT: an unvisited child first, else the best mean plus exploration */
+static int select_child( int node )
+{
+    const mcts_node_t *p = &arena[node];
+    float              lg = logf( (float)p->visits + 1 );
+    float              best_v = -1;
+    int                best = p->first;
+
+    for( int c=p->first; c<p->first+p->n; c++ )
+    {
+        float v;
+        if ( !arena[c].visits )
+            return c;
+        v = arena[c].wins / (2.0f * arena[c].visits) + MCTS_C * sqrtf( lg / arena[c].visits );
+        if ( v > best_v )
+        {
+            best_v = v;
+            best   = c;
+        }
+    }
+    return best;
+}
+
+/*
+ *  A square where s makes five, -1 if none
+ */
+static int win_in_one( tictactoe_t *b, uint8_t s )
+{
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+        for( uint64_t bits = fr.near1[w]; bits; bits &= bits-1 )
+        {
+            int q = 64*w + __builtin_ctzll( bits );
+            int x = q % TICTACTOE_STRIDE, y = q / TICTACTOE_STRIDE;
+            int won;
+
+            b->bits[s-1][ q >> 6 ] |= bits & -bits;
+            won = tictac_check_move( b, x, y );
+            b->bits[s-1][ q >> 6 ] &= ~(bits & -bits);
+            if ( won )
+                return x + N*y;
+        }
+    return -1;
+}
+
+/********************************************************************************/
+
+int tictac_mcts( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                 uint32_t time_ms, mcts_stats_t *st )
+{
+    uint64_t    start = now_ms(), deadline = start + time_ms - time_ms/10;
+    tictactoe_t t = *b;
+    uint32_t    playouts = 0;
+    int         best, p;
+
+    tictac_frontier_init( &fr_root, b );
+    fr = fr_root;
+    if ( (p = win_in_one( &t, s )) >= 0 || (p = win_in_one( &t, 3-s )) >= 0 )
+    {
+        *x = p % N;
+        *y = p / N;
+        if ( st )
+            memset( st, 0, sizeof(mcts_stats_t) );
+        return 0;
+    }
+
+    used = 1;
+    memset( &arena[0], 0, sizeof(mcts_node_t) );
+    if ( !expand( 0 ) )
+    {
+        uint64_t m[ TICTACTOE_WORDS ];
+        if ( tictac_moves( b, m ) == TICTACTOE_N )  // empty board
+        {
+            *x = *y = N/2;
+            return 0;
+        }
+        return -1;
+    }
+
+    while( (playouts & 15) || now_ms() < deadline )
+    {
+        int     path[ MCTS_DEPTH ];
+        int     k = 0, node = 0, winner = -1;
+        uint8_t m = s;
+
+        t  = *b;
+        fr = fr_root;
+        path[k++] = 0;
+        while( winner < 0 && k < MCTS_DEPTH )
+        {
+            if ( !arena[node].n &&
+                 (arena[node].visits + 1 < MCTS_EXPAND || !expand( node )) )
+                break;
+            node = select_child( node );
+            path[k++] = node;
+            if ( play( &t, arena[node].move, m ) || arena[node].done )
+            {
+                arena[node].done = 1;
+                winner = m;
+            }
+            m = 3-m;
+            if ( !arena[node].visits )
+                break;   // new in the tree, play out from here
+        }
+        if ( winner < 0 )
+            winner = playout( &t, m );
+        playouts++;
+
+        for( int i=0; i<k; i++ )   // path[i] is a move of s for odd i
+        {
+            uint8_t mover = (i & 1) ? s : 3-s;
+            arena[ path[i] ].visits++;
+            arena[ path[i] ].wins += winner == mover ? 2 : winner == 0 ? 1 : 0;
+        }
+    }
+
+    best = arena[0].first;
+    for( int c=arena[0].first; c<arena[0].first+arena[0].n; c++ )
+        if ( arena[c].visits > arena[best].visits )
+            best = c;
+    *x = arena[best].move % N;
+    *y = arena[best].move / N;
+    if ( st )
+    {
+        st->playouts = playouts;
+        st->nodes    = used;
+        st->ms       = now_ms() - start;
+        st->visits   = arena[best].visits;
+    }
+    return 0;
+}
+
+/********************************************************************************/
+
+#ifdef MCTS_HOST
+
+/*
+ *  Self-play against tictac_auto():  ./mcts [games [ms]]
+ *
+ *  MCTS takes crosses in even games and circles in odd ones; the first
+ *  cross is at random near the centre so the games differ.
+ */
+int main( int argc, char **argv )
+{
+    int      games = argc > 1 ? atoi( argv[1] ) : 20;
+    int      ms    = argc > 2 ? atoi( argv[2] ) : 200;
+    int      won = 0, lost = 0, tied = 0;
+    uint64_t playouts = 0, time = 0;
+
+    srand( 1 );
+    for( int g=0; g<games; g++ )
+    {
+        tictactoe_t b;
+        uint8_t     me = 1 + (g & 1);
+        int         res = 0, x, y;
+
+        memset( &b, 0, sizeof(b) );
+        tictac_set( &b, N/2 - 2 + rand() % 5, N/2 - 2 + rand() % 5, 1 );
+        for( int k=1; k<TICTACTOE_N && !res; k++ )
+        {
+            uint8_t      s = 1 + (k & 1);
+            mcts_stats_t st;
+
+            if ( s == me )
+            {
+                if ( tictac_mcts( &b, &x, &y, s, ms, &st ) )
+                    break;
+                playouts += st.playouts;
+                time     += st.ms;
+            }
+            else if ( tictac_auto( &b, &x, &y, s ) )
+                break;
+            if ( tictac_set( &b, x, y, s ) )
+            {
+                printf( "Game %d: illegal move (%d,%d) by %d\n", g, x, y, s );
+                return -1;
+            }
+            res = tictac_check_move( &b, x, y );
+        }
+        won  += res == me;
+        lost += res == 3-me;
+        tied += !res;
+    }
+    printf( "mcts vs tictac_auto, %d ms a move: %d won, %d lost, %d tied\n", ms, won, lost, tied );
+    printf( "%.0f playouts/s\n", time ? 1000.0 * playouts / time : 0.0 );
+    return 0;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TICTAC_MCTS_H
+#define TICTAC_MCTS_H
+
+#include <stdint.h>
+
+#include "tictactoe.h"
+
+/*
+ *  Monte Carlo tree search for five in a row
+ *
+ *  UCT over the empty squares next to a stone, random playouts among
+ *  the same squares (both from tictac_frontier.c), and the most
+ *  visited move when the time is up.  The tree is in a static arena of MCTS_NODES that every
+ *  move starts afresh, so there is no malloc; when it is full the
+ *  leaves are not expanded any more but the playouts go on.
+ *
+ *  Before the tree a guard takes a win in one, or blocks the
+ *  opponent's, which random playouts easily miss.
+ *
+ *  Compile with -DMCTS_HOST for a host binary that plays against
+ *  tictac_auto() and reports playouts/s:
+ *
+ *    gcc -Wall -O2 -DMCTS_HOST -I. -o mcts tictac_mcts.c tictac_frontier.c tictactoe.c -lm
+ */
+
+#define MCTS_NODES     4096    // arena, 16 octets each
+#define MCTS_WIDTH       24    // children of a node, those with most stones around
+#define MCTS_EXPAND       2    // visits of a leaf before it gets children
+#define MCTS_PLAYOUT     60    // plies, a tie if nobody won by then
+#define MCTS_DEPTH       64    // of the tree, at most
+#define MCTS_C         0.7f    // exploration
+
+typedef struct
+{
+    uint32_t  playouts;
+    uint32_t  nodes;    // of the arena used
+    uint32_t  ms;
+    uint32_t  visits;   // of the move taken
+} mcts_stats_t;
+
+int tictac_mcts( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                 uint32_t time_ms, mcts_stats_t *st );   // st may be NULL
+
+#endif
@@ -9,6 +9,10 @@
 #include <string.h>
 
 #include "tictactoe.h"
+#include "games.h"
+#include "tictac_search.h"
+#include "tictac_mcts.h"
+#include "tictac_book.h"
 
 /*
  * Identical to lownet_crc()
@@ -34,18 +38,66 @@ uint32_t crc24(const uint8_t *buf, size_t len) {
 }
 
 /*
- *  Milestone I: write code after the 'TODO'
+ *  Milestone I: the CRC of the 2-bit packing (tictactoe_packed_t)
  */
 uint32_t tictac_checksum(const tictactoe_t *b) {
-  uint8_t b4[TICTACTOE_N2]; // work here
+  tictactoe_packed_t b4;
 
-  /* Init the memory chunk */
-  memset(b4, 0, TICTACTOE_N2); // clear all?
+  tictac_pack(b, &b4);
+  return crc24(b4.bdata, TICTACTOE_N2);
+}
+
+/*
+ * The CRC is linear: the register ends up as init*x^L + M(x) mod G(x),
+ * the first bit of the message having the highest degree.  Changing
+ * octet n by d (fed LSB first) thus changes the CRC by
+ * rev8(d) * x^(8*(N2-1-n)) mod G(x), and a move changes one octet.
+ */
+static uint32_t xpow[TICTACTOE_N2 + 1]; // x^(8m) mod G(x)
+
+static uint32_t mulmod(uint32_t a, uint32_t b) {
+  static const uint32_t poly = 0x1800463ul;
+  uint32_t r = 0;
+
+  for (int i = 23; i >= 0; i--) {
+    r <<= 1;
+    if (r & 0x1000000ul)
+      r ^= poly;
+    if ((a >> i) & 1)
+      r ^= b;
+  }
+  return r;
+}
+
+/*
+ * Shards on both cores may get here first: the table is filled in
+ * full and only then published, so nobody reads it half done.  Two
+ * tasks filling it at once write the same values.
+ */
+static void xpow_init(void) {
+  static int ready = 0;
 
-  /* TODO: encode the given board b into b4 */
+  if (__atomic_load_n(&ready, __ATOMIC_ACQUIRE))
+    return;
+  xpow[0] = 1;
+  for (int m = 1; m <= TICTACTOE_N2; m++)
+    xpow[m] = mulmod(xpow[m - 1], 0x100);
+  __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+}
 
-  /* Then compute the CRC code */
-  return crc24(b4, TICTACTOE_N2);
+uint32_t tictac_checksum_empty(void) {
+  xpow_init();
+  return mulmod(0x00777777, xpow[TICTACTOE_N2]);
+}
+
+uint32_t tictac_checksum_move(uint32_t crc, int i, int j, uint8_t s) {
+  int k = i + TICTACTOE_BOARD * j;
+  uint8_t d = s << 2 * (k % 4), r = 0;
+
+  for (int n = 0; n < 8; n++)
+    r |= ((d >> n) & 1) << (7 - n);
+  xpow_init();
+  return crc ^ mulmod(r, xpow[TICTACTOE_N2 - 1 - k / 4]);
 }
 
 /*
@@ -58,10 +110,22 @@ uint32_t tictac_checksum(const tictactoe_t *b) {
  *  - Return value 0 on making a succesful move (always!)
  */
 
+static int policy = TICTAC_POLICY_AB;
+
+int tictac_policy(int e) {
+  if (e == TICTAC_POLICY_AB || e == TICTAC_POLICY_MCTS)
+    policy = e;
+  return policy;
+}
+
 int tictac_move(const tictactoe_t *b, int *xp, int *yp, uint8_t s,
                 uint32_t time_ms) {
-  /*
-   * TODO: figure out a better move!
-   */
-  return tictac_auto(b, xp, yp, s);
+  if (!tictac_book_move(b, xp, yp))
+    return 0;
+  int r = policy == TICTAC_POLICY_MCTS
+              ? tictac_mcts(b, xp, yp, s, time_ms, NULL)
+              : tictac_search(b, xp, yp, s, time_ms, NULL);
+  if (!r)
+    return 0;
+  return tictac_auto(b, xp, yp, s); // no candidates, take anything
 }
@@ -0,0 +1,554 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <stdlib.h>
+#include <time.h>
+#endif
+
+#include "tictactoe.h"
+#include "tictac_eval.h"
+#include "tictac_frontier.h"
+#include "tictac_search.h"
+
+#define N        TICTACTOE_BOARD
+#define INF      (SEARCH_WIN + 1000)
+#define MATE     (SEARCH_WIN - 100)     // scores beyond are wins in so many plies
+
+#define TT_EXACT   1
+#define TT_LOWER   2                    // score at least
+#define TT_UPPER   3                    // score at most
+
+/*
+ *  Transposition entry: the full digest, the score, and the best move
+ *  (square x + 30*y) in 10 bits, the bound in 2 and the depth in 4
+ */
+typedef struct
+{
+    uint32_t  key;
+    int16_t   score;
+    uint16_t  info;
+} tt_entry_t;
+
+static struct
+{
+    tictactoe_t        b;
+    uint32_t           key;       // tictac_digest() of b
+    tictac_eval_t      ev;        // ..its windows
+    tictac_frontier_t  fr;        // ..and the squares near its stones
+    uint32_t           nodes;
+    uint32_t           deadline;  // ms, the low bits of now_ms()
+    volatile const uint32_t *until;   // &deadline, or the ponderer's
+    uint32_t           pv_key;    // the board after the move found
+    int                pv_reply;  // ..and the answer expected, or -1
+    int                stop;
+    uint16_t           killer[ SEARCH_MAX_DEPTH ][2];
+    uint16_t           history[2][ TICTACTOE_N ];
+    tt_entry_t         tt[ 1 << SEARCH_TT_BITS ];
+} S;
+
+static uint64_t now_ms( void )
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time() / 1000;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* a move is its square p = x + 30*y */
+static void make( int p, uint8_t s )
+{
+    int x = p % N, y = p / N;
+    int q = x + TICTACTOE_STRIDE*y;
+
+    S.b.bits[s-1][ q >> 6 ] |= 1ull << (q & 63);
+    S.key ^= tictac_dcell( x, y, s );
+    tictac_eval_move( &S.ev, x, y, s );
+    tictac_frontier_move( &S.fr, x, y );
+}
+
+static void unmake( int p, uint8_t s )
+{
+    int x = p % N, y = p / N;
+    int q = x + TICTACTOE_STRIDE*y;
+
+    S.b.bits[s-1][ q >> 6 ] &= ~(1ull << (q & 63));
+    S.key ^= tictac_dcell( x, y, s );
+    tictac_eval_undo( &S.ev, x, y, s );
+    tictac_frontier_undo( &S.fr, x, y );
+}
+
+static int evaluate( uint8_t s )
+{
+    int v = tictac_eval_score( &S.ev, s );
+    return v > MATE/2 ? MATE/2 : v < -MATE/2 ? -MATE/2 : v;
+}
+
+/*
+ *  A square where c makes five, -1 if none
+ */
+static int five_square( uint8_t c )
+{
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+        for( uint64_t bits = S.fr.near1[w]; bits; bits &= bits-1 )
+        {
+            int q = 64*w + __builtin_ctzll( bits );
+            int x = q % TICTACTOE_STRIDE, y = q / TICTACTOE_STRIDE;
+            int won;
+
+            S.b.bits[c-1][ q >> 6 ] |= bits & -bits;
+            won = tictac_check_move( &S.b, x, y );
+            S.b.bits[c-1][ q >> 6 ] &= ~(bits & -bits);
+            if ( won )
+                return x + N*y;
+        }
+    return -1;
+}
+
+/*
+ *  The width best candidates of s, in order: a five of s or the block
+ *  of one of the opponent's (a square the stones around would not rank
+ *  high enough), the table's move, the killers, then history and
+ *  stones around
+ */
+static int generate( int ply, uint8_t s, int tt_move, uint16_t *moves, int width )
+{
+    const uint64_t *m = SEARCH_NEAR == 1 ? S.fr.near1 : S.fr.near2;
+    int32_t         val[ SEARCH_ROOT_WIDTH ];
+    int             n = 0, urgent = -1;
+
+    if ( S.ev.threats[s-1][ EVAL_FOUR ] )
+        urgent = five_square( s );
+    if ( urgent < 0 && S.ev.threats[2-s][ EVAL_FOUR ] )
+        urgent = five_square( 3-s );
+
+    for( int w=0; w<TICTACTOE_WORDS; w++ )
+        for( uint64_t bits = m[w]; bits; bits &= bits-1 )
+        {
+            int     q = 64*w + __builtin_ctzll( bits );
+            int     x = q % TICTACTOE_STRIDE, y = q / TICTACTOE_STRIDE;
+            int     p = x + N*y;
+            int32_t v = p == urgent               ? INT32_MAX :
+                        p == tt_move              ? 1 << 30 :
+                        p == S.killer[ply][0]     ? 1 << 29 :
+                        p == S.killer[ply][1]     ? 1 << 28 :
+                        S.history[s-1][p] + 64*S.fr.count1[p];
+            int     k = n < width ? n++ : width;
+
+            while ( k > 0 && val[k-1] < v )   // keep the best width, sorted
+            {
+                if ( k < width )
+                {
+                    moves[k] = moves[k-1];
+                    val[k]   = val[k-1];
+                }
+                k--;
+            }
+            if ( k < width )
+            {
+                moves[k] = p;
+                val[k]   = v;
+            }
+        }
+    return n;
+}
+
+static void tt_store( int depth, int ply, int score, int flag, int move )
+{
+    tt_entry_t *e = &S.tt[ S.key & ((1 << SEARCH_TT_BITS) - 1) ];
+
+    if ( score > MATE )         // wins from here, not from the root
+        score += ply;
+    else if ( score < -MATE )
+        score -= ply;
+    e->key   = S.key;
+    e->score = score;
+    e->info  = move | (flag << 10) | (depth << 12);
+}
+
+/*
+ *  Score of s to move after the opponent took square last
+ */
+static int negamax( int depth, int alpha, int beta, int ply, uint8_t s, int last )
+{
+    uint16_t  moves[ SEARCH_WIDTH ];
+    int       alpha0 = alpha, best = -INF, best_move = -1, tt_move = -1, n;
+
+    if ( tictac_check_move( &S.b, last % N, last / N ) )
+        return -(SEARCH_WIN - ply);
+    if ( (++S.nodes & 1023) == 0 && (int32_t)((uint32_t)now_ms() - *S.until) >= 0 )
+        S.stop = 1;
+    if ( S.stop )
+        return 0;
+    if ( depth == 0 || ply >= SEARCH_MAX_DEPTH )
+        return evaluate( s );
+
+    tt_entry_t *e = &S.tt[ S.key & ((1 << SEARCH_TT_BITS) - 1) ];
+    if ( e->key == S.key && e->info )
+    {
+        int score = e->score;
+        int flag  = (e->info >> 10) & 3;
+
+        tt_move = e->info & 0x3ff;
+        if ( score > MATE )
+            score -= ply;
+        else if ( score < -MATE )
+            score += ply;
+        if ( (e->info >> 12) >= depth )
+        {
+            if ( flag == TT_EXACT )
+                return score;
+            if ( flag == TT_LOWER && score > alpha )
+                alpha = score;
+            if ( flag == TT_UPPER && score < beta )
+                beta = score;
+            if ( alpha >= beta )
+                return score;
+        }
+    }
+
+    n = generate( ply, s, tt_move, moves, SEARCH_WIDTH );
+    if ( !n )
+        return 0;   // board full
+    for( int i=0; i<n; i++ )
+    {
+        int v;
+
+        make( moves[i], s );
+        v = -negamax( depth-1, -beta, -alpha, ply+1, 3-s, moves[i] );
+        unmake( moves[i], s );
+        if ( S.stop )
+            return 0;
+        if ( v > best )
+        {
+            best      = v;
+            best_move = moves[i];
+        }
+        if ( v > alpha )
+            alpha = v;
+        if ( alpha >= beta )
+        {
+            if ( S.killer[ply][0] != moves[i] )
+            {
+                S.killer[ply][1] = S.killer[ply][0];
+                S.killer[ply][0] = moves[i];
+            }
+            if ( S.history[s-1][ moves[i] ] < 0xffff - depth*depth )
+                S.history[s-1][ moves[i] ] += depth*depth;
+            break;
+        }
+    }
+    tt_store( depth, ply, best, best <= alpha0 ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT, best_move );
+    return best;
+}
+
+/*
+ *  One depth at the root.  *bi is the best of the moves finished,
+ *  -1 if not even the first one was; reply[i] the table's answer to
+ *  moves[i] right after its search, before later ones replace it.
+ */
+static int root( int depth, int alpha, int beta, uint8_t s, const uint16_t *moves, int n,
+                 int16_t *reply, int *bi )
+{
+    int best = -INF;
+
+    *bi = -1;
+    for( int i=0; i<n; i++ )
+    {
+        tt_entry_t *e;
+        int         v;
+
+        make( moves[i], s );
+        v = -negamax( depth-1, -beta, -alpha, 1, 3-s, moves[i] );
+        e = &S.tt[ S.key & ((1 << SEARCH_TT_BITS) - 1) ];
+        if ( !S.stop )
+            reply[i] = e->key == S.key && e->info ? e->info & 0x3ff : -1;
+        unmake( moves[i], s );
+        if ( S.stop )
+            break;
+        if ( v > best )
+        {
+            best = v;
+            *bi  = i;
+        }
+        if ( v > alpha )
+            alpha = v;
+        if ( alpha >= beta )
+            break;
+    }
+    return best;
+}
+
+/********************************************************************************/
+
+static int search( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                   uint64_t start, search_stats_t *st )
+{
+    uint16_t moves[ SEARCH_ROOT_WIDTH ];
+    int16_t  reply[ SEARCH_ROOT_WIDTH ];
+    int      n, score = 0, depth = 0;
+
+    S.b        = *b;
+    S.key      = tictac_digest( b );
+    tictac_eval_init( &S.ev, b );
+    tictac_frontier_init( &S.fr, b );
+    S.nodes    = 0;
+    S.stop     = 0;
+    S.pv_reply = -1;
+    memset( S.killer, 0xff, sizeof(S.killer) );
+    for( int p=0; p<TICTACTOE_N; p++ )
+    {
+        S.history[0][p] >>= 1;
+        S.history[1][p] >>= 1;
+    }
+
+    n = generate( 0, s, -1, moves, SEARCH_ROOT_WIDTH );
+    memset( reply, 0xff, sizeof(reply) );
+    if ( !n )
+    {
+        uint64_t m[ TICTACTOE_WORDS ];
+        if ( tictac_moves( b, m ) == TICTACTOE_N )  // empty board
+        {
+            *x = *y = N/2;
+            return 0;
+        }
+        return -1;
+    }
+
+    for( int d=1; d<=SEARCH_MAX_DEPTH; d++ )
+    {
+        int alpha = d > 1 ? score - SEARCH_WINDOW : -INF;
+        int beta  = d > 1 ? score + SEARCH_WINDOW :  INF;
+        int v, bi;
+
+        while( 1 )
+        {
+            v = root( d, alpha, beta, s, moves, n, reply, &bi );
+            if ( S.stop || (v > alpha && v < beta) )
+                break;
+            if ( v <= alpha )
+                alpha = -INF;
+            else
+                beta = INF;
+        }
+        if ( bi > 0 && v > alpha )   // new best, first ahead next time
+        {
+            uint16_t m = moves[bi];
+            int16_t  r = reply[bi];
+            memmove( &moves[1], &moves[0], bi * sizeof(uint16_t) );
+            memmove( &reply[1], &reply[0], bi * sizeof(int16_t) );
+            moves[0] = m;
+            reply[0] = r;
+        }
+        if ( S.stop )
+            break;
+        score = v;
+        depth = d;
+        if ( score > MATE || score < -MATE )
+            break;
+    }
+
+    *x = moves[0] % N;
+    *y = moves[0] / N;
+    S.pv_key   = S.key ^ tictac_dcell( *x, *y, s );
+    S.pv_reply = reply[0];
+    if ( st )
+    {
+        st->nodes = S.nodes;
+        st->ms    = now_ms() - start;
+        st->depth = depth;
+        st->score = score;
+    }
+    return 0;
+}
+
+int tictac_search( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                   uint32_t time_ms, search_stats_t *st )
+{
+    uint64_t start = now_ms();
+
+    S.deadline = start + time_ms - time_ms/10;   // time to send it, too
+    S.until    = &S.deadline;
+    return search( b, x, y, s, start, st );
+}
+
+int tictac_ponder( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                   volatile const uint32_t *until, search_stats_t *st )
+{
+    S.until = until;
+    return search( b, x, y, s, now_ms(), st );
+}
+
+int tictac_search_reply( const tictactoe_t *b )
+{
+    uint32_t          key = tictac_digest( b );
+    const tt_entry_t *e   = &S.tt[ key & ((1 << SEARCH_TT_BITS) - 1) ];
+    int               p   = key == S.pv_key ? S.pv_reply :
+                            e->key == key && e->info ? e->info & 0x3ff : -1;
+
+    if ( p < 0 || p >= TICTACTOE_N || tictac_get( b, p % N, p / N ) )
+        return -1;
+    return p;
+}
+
+uint32_t tictac_search_now( void )
+{
+    return now_ms();
+}
+
+/********************************************************************************/
+
+#ifdef SEARCH_HOST
+
+/*
+ *  Self-play against tictac_auto():  ./search [games [ms]]
+ *
+ *  The search takes crosses in even games and circles in odd ones; the
+ *  first cross is at random near the centre so the games differ.
+ */
+/*
+ *  The windows and the frontier against fresh ones after random moves
+ *  and takebacks, then evaluations/s: a move, its score and the takeback, against
+ *  counting the open runs with tictac_open() after the move
+ */
+static int open_runs( const tictactoe_t *b, uint8_t s )
+{
+    static const int weight[5] = { 0, 0, 20, 300, 5000 };
+    int v = 0;
+
+    for( int n=2; n<=4; n++ )
+        v += weight[n] * ( tictac_open( b, s, n ) - tictac_open( b, 3-s, n ) );
+    return v;
+}
+
+static void take_back( tictactoe_t *b, int x, int y, uint8_t s )
+{
+    int q = x + TICTACTOE_STRIDE*y;
+    b->bits[s-1][ q >> 6 ] &= ~(1ull << (q & 63));
+}
+
+static int eval_bench( void )
+{
+    enum { MOVES = 120, REPS = 200000 };
+    tictactoe_t       b;
+    tictac_eval_t     e, f;
+    tictac_frontier_t fe, ff;
+    int           xs[ MOVES ], ys[ MOVES ], n = 0;
+    volatile int  sink = 0;
+    uint64_t      t0;
+    double        t_inc, t_open;
+
+    memset( &b, 0, sizeof(b) );
+    tictac_eval_init( &e, &b );
+    tictac_frontier_init( &fe, &b );
+    for( int k=0; n<MOVES; k++ )
+    {
+        int x = rand() % N, y = rand() % N;
+        if ( tictac_set( &b, x, y, 1 + (n & 1) ) )
+            continue;
+        tictac_eval_move( &e, x, y, 1 + (n & 1) );
+        tictac_frontier_move( &fe, x, y );
+        xs[n] = x;
+        ys[n] = y;
+        n++;
+        if ( k % 7 == 0 )   // take the last one back
+        {
+            n--;
+            take_back( &b, xs[n], ys[n], 1 + (n & 1) );
+            tictac_eval_undo( &e, xs[n], ys[n], 1 + (n & 1) );
+            tictac_frontier_undo( &fe, xs[n], ys[n] );
+        }
+        tictac_eval_init( &f, &b );
+        tictac_frontier_init( &ff, &b );
+        if ( memcmp( &e, &f, sizeof(e) ) || memcmp( &fe, &ff, sizeof(fe) ) )
+        {
+            printf( "Evaluation or frontier differs from a fresh one after %d moves\n", n );
+            return -1;
+        }
+    }
+
+    t0 = now_ms();
+    for( int r=0; r<REPS; r++ )
+    {
+        int x = r % N, y = (r / N) % N;
+        if ( tictac_get( &b, x, y ) )
+            continue;
+        tictac_eval_move( &e, x, y, 1 );
+        sink += tictac_eval_score( &e, 2 );
+        tictac_eval_undo( &e, x, y, 1 );
+    }
+    t_inc = (now_ms() - t0) / 1000.0;
+
+    t0 = now_ms();
+    for( int r=0; r<REPS/10; r++ )
+    {
+        int x = r % N, y = (r / N) % N;
+        if ( tictac_set( &b, x, y, 1 ) )
+            continue;
+        sink += open_runs( &b, 2 );
+        take_back( &b, x, y, 1 );
+    }
+    t_open = (now_ms() - t0) / 1000.0 * 10;
+
+    printf( "evaluations/s: %.0f incremental, %.0f open runs\n", REPS / t_inc, REPS / t_open );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    int      games = argc > 1 ? atoi( argv[1] ) : 20;
+    int      ms    = argc > 2 ? atoi( argv[2] ) : 200;
+    int      won = 0, lost = 0, tied = 0;
+    uint64_t nodes = 0, time = 0, depths = 0, searches = 0;
+
+    srand( 1 );
+    if ( eval_bench() )
+        return -1;
+    for( int g=0; g<games; g++ )
+    {
+        tictactoe_t b;
+        uint8_t     me = 1 + (g & 1);
+        int         res = 0, x, y;
+
+        memset( &b, 0, sizeof(b) );
+        tictac_set( &b, N/2 - 2 + rand() % 5, N/2 - 2 + rand() % 5, 1 );
+        for( int k=1; k<TICTACTOE_N && !res; k++ )
+        {
+            uint8_t        s = 1 + (k & 1);
+            search_stats_t st;
+
+            if ( s == me )
+            {
+                if ( tictac_search( &b, &x, &y, s, ms, &st ) )
+                    break;
+                nodes  += st.nodes;
+                time   += st.ms;
+                depths += st.depth;
+                searches++;
+            }
+            else if ( tictac_auto( &b, &x, &y, s ) )
+                break;
+            if ( tictac_set( &b, x, y, s ) )
+            {
+                printf( "Game %d: illegal move (%d,%d) by %d\n", g, x, y, s );
+                return -1;
+            }
+            res = tictac_check_move( &b, x, y );
+        }
+        won  += res == me;
+        lost += res == 3-me;
+        tied += !res;
+    }
+    printf( "search vs tictac_auto, %d ms a move: %d won, %d lost, %d tied\n", ms, won, lost, tied );
+    printf( "%.0f nodes/s, depth %.1f on average\n",
+            time ? 1000.0 * nodes / time : 0.0, searches ? (double)depths / searches : 0.0 );
+    return 0;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TICTAC_SEARCH_H
+#define TICTAC_SEARCH_H
+
+#include <stdint.h>
+
+#include "tictactoe.h"
+
+/*
+ *  Game tree search for five in a row
+ *
+ *  Iterative deepening alpha-beta with aspiration windows, killer and
+ *  history move ordering and a transposition table keyed by the board
+ *  digest (tictac_dcell() are the Zobrist keys).  Candidates are the
+ *  empty squares near the stones, kept by tictac_frontier.c, the best
+ *  ordered SEARCH_WIDTH of them at inner nodes.  Leaves are scored by
+ *  the windows of tictac_eval.c.  The move is that of the last
+ *  finished depth, or a better one already found at the next when the
+ *  time runs out.
+ *
+ *  Compile with -DSEARCH_HOST for a host binary that checks and times
+ *  the evaluation, then plays the search against tictac_auto():
+ *
+ *    gcc -Wall -O2 -DSEARCH_HOST -I. -o search tictac_search.c tictac_eval.c tictac_frontier.c tictac_mcts.c tictactoe.c tictac_node.c tictac_book.c -lm
+ */
+
+#define SEARCH_TT_BITS     12    // 4096 entries of 8 octets, internal RAM
+#define SEARCH_MAX_DEPTH   12
+#define SEARCH_WIDTH       12    // moves tried at inner nodes
+#define SEARCH_ROOT_WIDTH  32    // ..and at the root
+#define SEARCH_NEAR         2    // candidates: at most this far from a stone, 1 or 2
+#define SEARCH_WINDOW     150    // aspiration, either side of the last score
+#define SEARCH_WIN      30000    // five in a row, less the plies to it
+
+typedef struct
+{
+    uint32_t  nodes;
+    uint32_t  ms;
+    uint8_t   depth;    // last one finished
+    int32_t   score;    // for the side to move
+} search_stats_t;
+
+int tictac_search( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                   uint32_t time_ms, search_stats_t *st );   // st may be NULL
+
+/*
+ *  Pondering: the same search, but until *until (tictac_search_now()
+ *  time), which another task may move while it runs, to stop it or to
+ *  give it the time of a move.  The table stays from one search to the
+ *  next, so even a search started afresh on the same board is quick.
+ */
+int      tictac_ponder( const tictactoe_t *b, int *x, int *y, uint8_t s,
+                        volatile const uint32_t *until, search_stats_t *st );
+int      tictac_search_reply( const tictactoe_t *b );  // answer the last search expects on b, else the table's, x + 30*y or -1
+uint32_t tictac_search_now( void );                    // ms
+
+#endif
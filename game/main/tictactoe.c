@@ -11,36 +11,146 @@
  *
  *    gcc -Wall -DSTANDALONE -o tictactoe tictactoe.c
  *
+ *  and "./tictactoe bench" times the bitboard against a byte board,
+ *  "./tictactoe test" checks the codec round trips and the last-move
+ *  win test against a full scan.
+ *
  *
  *  Oct 29, 2023 -- esa@hi.is
  */
 
 /*
- *  Encode the sparse memory representation to packet payload
- *  using 1 byte per 5 squares.
+ *  Square (i,j) is bit i + TICTACTOE_STRIDE*j of a side's mask; bit 30
+ *  of every row is never set, so a run that leaves the board on the
+ *  right or left meets an empty pad square instead of the next row.
  */
-int tictac_encode( const tictactoe_t *b, tictactoe_payload_t *p )
+#define WORDS   TICTACTOE_WORDS
+#define STRIDE  TICTACTOE_STRIDE
+
+static const int dirs[4] = { 1, STRIDE, STRIDE+1, STRIDE-1 };  // -, |, \, /
+
+/* out = a >> d over the whole mask: square p of out is square p+d of a */
+static void mask_shr( const uint64_t *a, int d, uint64_t *out )
 {
-    uint8_t B = 1; // B = 1, 3, 9, 27, 81, 1, ...
-    uint8_t v = 0;
-    int     j = 0;
-    
-    for( int i=0; i<TICTACTOE_N; i++)
+    int q = d >> 6, r = d & 63;
+    for( int w=0; w<WORDS; w++ )
     {
-        v  += b->board[i]*B;
-        if ( B >= 81 ) 
+        uint64_t lo = w+q   < WORDS ? a[w+q]   : 0;
+        uint64_t hi = w+q+1 < WORDS ? a[w+q+1] : 0;
+        out[w] = r ? (lo >> r) | (hi << (64-r)) : lo;
+    }
+}
+
+/* out = a << d: square p of out is square p-d of a */
+static void mask_shl( const uint64_t *a, int d, uint64_t *out )
+{
+    int q = d >> 6, r = d & 63;
+    for( int w=WORDS-1; w>=0; w-- )
+    {
+        uint64_t hi = w-q   >= 0 ? a[w-q]   : 0;
+        uint64_t lo = w-q-1 >= 0 ? a[w-q-1] : 0;
+        out[w] = r ? (hi << r) | (lo >> (64-r)) : hi;
+    }
+}
+
+/* all squares of the board, no pads */
+static const uint64_t *mask_board( void )
+{
+    static uint64_t m[ WORDS ];
+    if ( !m[0] )
+        for( int j=0; j<TICTACTOE_BOARD; j++ )
+            for( int i=0; i<TICTACTOE_BOARD; i++ )
+            {
+                int p = i + STRIDE*j;
+                m[ p >> 6 ] |= 1ull << (p & 63);
+            }
+    return m;
+}
+
+/*
+ *  Subroutines with no range checks!
+ *
+ *  tictac_get() returns the piece at (i,j), if any (0,1,2)
+ *  set_board() sets piece s to (i,j), return zero on success.
+ *
+ */
+uint8_t tictac_get( const tictactoe_t *b, int i, int j )
+{
+    int      p = i + STRIDE*j;
+    uint64_t m = 1ull << (p & 63);
+    return (b->bits[0][ p >> 6 ] & m) ? 1 : (b->bits[1][ p >> 6 ] & m) ? 2 : 0;
+}
+
+
+int tictac_set( tictactoe_t *b, int i, int j, uint8_t s )
+{
+    int      p = i + STRIDE*j;
+    uint64_t m = 1ull << (p & 63);
+    if ( (b->bits[0][ p >> 6 ] | b->bits[1][ p >> 6 ]) & m )  // already taken
+        return -1;
+    if ( s == 1 || s == 2 )
+        b->bits[s-1][ p >> 6 ] |= m;
+    return 0;
+}
+
+/*
+ *  Payload codec: octet k holds squares 5k..5k+4, which are in one row
+ *  as 30 is a multiple of 5, so they are five neighbouring bits of each
+ *  bitboard.  Tables instead of the base 3 arithmetic:
+ *
+ *    dec[v]      the crosses and circles of octet v as 5-bit masks
+ *    enc[x|o<<5] the octet of 5-bit masks x and o
+ */
+static uint8_t dec[243][2];
+static uint8_t enc[1024];
+
+static void codec_tables( void )
+{
+    if ( dec[242][1] )   // last one set, all circles
+        return;
+    for( int v=0; v<243; v++ )
+    {
+        uint8_t x = 0, o = 0;
+        for( int k=0, B=v; k<5; k++, B/=3 )
         {
-            p->bdata[ j++ ] = v;
-            B = 1;
-            v = 0;
+            x |= (B % 3 == 1) << k;
+            o |= (B % 3 == 2) << k;
         }
-        else
-            B *= 3;
+        enc[ x | (o << 5) ] = v;
+        dec[v][0] = x;
+        dec[v][1] = o;
     }
-    if ( j != TICTACTOE_N3 || B!=1 )
+}
+
+/* the five squares at bit p.. of a bitboard */
+static uint8_t bits5( const uint64_t *m, int p )
+{
+    int      w = p >> 6, r = p & 63;
+    uint64_t v = m[w] >> r;
+    if ( r > 59 )
+        v |= m[w+1] << (64-r);
+    return v & 0x1f;
+}
+
+static void set5( uint64_t *m, int p, uint8_t v )
+{
+    int w = p >> 6, r = p & 63;
+    m[w] |= (uint64_t)v << r;
+    if ( r > 59 )
+        m[w+1] |= (uint64_t)v >> (64-r);
+}
+
+/*
+ *  Encode the sparse memory representation to packet payload
+ *  using 1 byte per 5 squares.
+ */
+int tictac_encode( const tictactoe_t *b, tictactoe_payload_t *p )
+{
+    codec_tables();
+    for( int k=0; k<TICTACTOE_N3; k++ )
     {
-        printf( "Oops, board encoding failed\n" );
-        return -1;
+        int q = 5*k + (5*k / TICTACTOE_BOARD);  // square 5k, one pad per row
+        p->bdata[k] = enc[ bits5( b->bits[0], q ) | (bits5( b->bits[1], q ) << 5) ];
     }
     return 0;
 }
@@ -49,25 +159,30 @@ int tictac_encode( const tictactoe_t *b, tictactoe_payload_t *p )
  * Decode the dense packet representation back to the
  * internal representation in memory that is fast to work with
  */
-int tictac_decode( const tictactoe_payload_t *p, tictactoe_t *b )
+static int decode( const tictactoe_payload_t *p, tictactoe_t *b )
 {
-    uint8_t B,v;
-    int     k = 0;
-    int     err = 0;
-    
-    for( int i=0; i<TICTACTOE_N3; i++)
+    int err = 0;
+
+    codec_tables();
+    memset( b, 0, sizeof(tictactoe_t) );
+    for( int k=0; k<TICTACTOE_N3; k++ )
     {
-        B = p->bdata[i];
-        for( int j=0; j<5; j++)
+        uint8_t v = p->bdata[k];
+        int     q = 5*k + (5*k / TICTACTOE_BOARD);
+        if ( v >= 243 )
         {
-            v = B % 3;
-            B = B / 3;
-            b->board[k++] = v;
-        }
-        if ( B )
             err++;
+            continue;
+        }
+        set5( b->bits[0], q, dec[v][0] );
+        set5( b->bits[1], q, dec[v][1] );
     }
-    if ( k != TICTACTOE_N || err )
+    return err ? -1 : 0;
+}
+
+int tictac_decode( const tictactoe_payload_t *p, tictactoe_t *b )
+{
+    if ( decode( p, b ) )
     {
         printf( "Oops, board decoding failed\n" );
         return -1;
@@ -75,83 +190,241 @@ int tictac_decode( const tictactoe_payload_t *p, tictactoe_t *b )
     return 0;
 }
 
-
 /*
- *  Subroutines with no range checks!
- *
- *  tictac_get() returns the piece at (i,j), if any (0,1,2)
- *  set_board() sets piece s to (i,j), return zero on success.
- *
+ *  The same for the 2-bit packed representation
  */
-uint8_t tictac_get( const tictactoe_t *b, int i, int j )
+uint8_t tictac_pget( const tictactoe_packed_t *p, int i, int j )
 {
-    return b->board[ i + TICTACTOE_BOARD*j ];
+    int pos = i + TICTACTOE_BOARD*j;
+    return (p->bdata[ pos >> 2 ] >> (2*(pos & 3))) & 3;
 }
 
-
-int tictac_set( tictactoe_t *b, int i, int j, uint8_t s )
+int tictac_pset( tictactoe_packed_t *p, int i, int j, uint8_t s )
 {
     int pos = i + TICTACTOE_BOARD*j;
-    if ( b->board[pos] )  // already taken
+    int sh  = 2*(pos & 3);
+    if ( (p->bdata[ pos >> 2 ] >> sh) & 3 )  // already taken
         return -1;
-    b->board[pos] = s;
+    p->bdata[ pos >> 2 ] |= (s & 3) << sh;
+    return 0;
+}
+
+uint32_t tictac_dcell( int i, int j, uint8_t s )
+{
+    uint32_t h = (uint32_t)(i + TICTACTOE_BOARD*j) * 4 + s + 0x9e3779b9u;
+
+    /* murmur3 finalizer */
+    h ^= h >> 16;  h *= 0x85ebca6bu;
+    h ^= h >> 13;  h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t tictac_digest( const tictactoe_t *b )
+{
+    uint32_t d = 0;
+    for( int s=0; s<2; s++ )
+        for( int w=0; w<WORDS; w++ )
+            for( uint64_t m = b->bits[s][w]; m; m &= m-1 )
+            {
+                int p = 64*w + __builtin_ctzll( m );
+                d ^= tictac_dcell( p % STRIDE, p / STRIDE, s+1 );
+            }
+    return d;
+}
+
+int tictac_pack( const tictactoe_t *b, tictactoe_packed_t *p )
+{
+    memset( p, 0, sizeof(tictactoe_packed_t) );
+    for( int s=0; s<2; s++ )
+        for( int w=0; w<WORDS; w++ )
+            for( uint64_t m = b->bits[s][w]; m; m &= m-1 )
+            {
+                int p0 = 64*w + __builtin_ctzll( m );
+                tictac_pset( p, p0 % STRIDE, p0 / STRIDE, s+1 );
+            }
+    return 0;
+}
+
+int tictac_unpack( const tictactoe_packed_t *p, tictactoe_t *b )
+{
+    memset( b, 0, sizeof(tictactoe_t) );
+    for( int k=0; k<TICTACTOE_N2; k++ )
+    {
+        uint8_t v = p->bdata[k];
+        for( int q=0; v; q++, v >>= 2 )
+            if ( v & 3 )
+                tictac_set( b, (4*k+q) % TICTACTOE_BOARD, (4*k+q) / TICTACTOE_BOARD, v & 3 );
+    }
     return 0;
 }
 
 void empty_board( tictactoe_t *b )
 {
-    memset( b->board, 0, TICTACTOE_N );
+    memset( b, 0, sizeof(tictactoe_t) );
 }
 
 /*
- *  Returns the winner, or zero if no winner
+ *  Legal moves: the empty squares of the board
  */
-int tictac_game_over( const tictactoe_t *b )
+int tictac_moves( const tictactoe_t *b, uint64_t *mask )
 {
-    int evaluate( int i, int j, int dx, int dy )
+    const uint64_t *all = mask_board();
+    int             n   = 0;
+
+    for( int w=0; w<WORDS; w++ )
     {
-        int i1 = i + 4*dx;
-        int j1 = j + 4*dx;
-        if ( i < 0 || i >= TICTACTOE_BOARD ||
-             j < 0 || j >= TICTACTOE_BOARD )
-        {
-            printf( "Oops" );
-            while(1)
-                ;
-        }
-        
-        if ( i1 < 0 || i1 >= TICTACTOE_BOARD ||
-             j1 < 0 || j1 >= TICTACTOE_BOARD )
-            return 0;
-        uint8_t s = tictac_get(b,i,j);
-        if ( !s )
-            return 0;
-        for( int k=0; k<4; k++ )  // four more and we are done!
+        mask[w] = all[w] & ~(b->bits[0][w] | b->bits[1][w]);
+        n += __builtin_popcountll( mask[w] );
+    }
+    return n;
+}
+
+/*
+ *  Empty squares at most dist squares from a stone, any direction:
+ *  the stones grown dist steps sideways, then up and down
+ */
+int tictac_near( const tictactoe_t *b, int dist, uint64_t *mask )
+{
+    const uint64_t *all = mask_board();
+    uint64_t        occ[ WORDS ], t[ WORDS ], u[ WORDS ];
+    int             n = 0;
+
+    for( int w=0; w<WORDS; w++ )
+        mask[w] = occ[w] = b->bits[0][w] | b->bits[1][w];
+    for( int k=0; k<2*dist; k++ )
+    {
+        int d = k < dist ? 1 : STRIDE;
+        mask_shr( mask, d, t );
+        mask_shl( mask, d, u );
+        for( int w=0; w<WORDS; w++ )
+            mask[w] = (mask[w] | t[w] | u[w]) & all[w];  // no pads
+    }
+    for( int w=0; w<WORDS; w++ )
+    {
+        mask[w] &= ~occ[w];
+        n += __builtin_popcountll( mask[w] );
+    }
+    return n;
+}
+
+/*
+ *  Open runs of exactly n stones of s in a line, with an empty square
+ *  at both ends (n = 3 and 4 are the ones that matter).
+ */
+int tictac_open( const tictactoe_t *b, uint8_t s, int n )
+{
+    const uint64_t *B = b->bits[ s-1 ];
+    uint64_t        E[ WORDS ], r[ WORDS ], t[ WORDS ];
+    int             c = 0;
+
+    tictac_moves( b, E );
+    for( int k=0; k<4; k++ )
+    {
+        int d = dirs[k];
+
+        memcpy( r, B, sizeof(r) );         // r: starts of n in a row
+        for( int m=1; m<n; m++ )
         {
-            i += dx;
-            j += dy;
-            if ( tictac_get(b,i,j) != s )
-                return 0;
+            mask_shr( B, m*d, t );
+            for( int w=0; w<WORDS; w++ )
+                r[w] &= t[w];
         }
-        return s;  // winner found!  1 or 2
+        mask_shl( E, d, t );               // empty before..
+        for( int w=0; w<WORDS; w++ )
+            r[w] &= t[w];
+        mask_shr( E, n*d, t );             // ..and after
+        for( int w=0; w<WORDS; w++ )
+            c += __builtin_popcountll( r[w] & t[w] );
     }
+    return c;
+}
 
-    for( int i=0; i<TICTACTOE_BOARD; i++)
+/*
+ *  Returns the winner, or zero if no winner
+ *
+ *  Five in a row in direction d is B & B>>d & B>>2d & B>>3d & B>>4d,
+ *  done in three steps: pairs, pairs of pairs, and the fifth.
+ */
+int tictac_game_over( const tictactoe_t *b )
+{
+    uint64_t t[ WORDS ], u[ WORDS ];
+
+    for( int s=0; s<2; s++ )
     {
-        for( int j=0; j<TICTACTOE_BOARD; j++)
+        const uint64_t *B = b->bits[s];
+        for( int k=0; k<4; k++ )
         {
-            int r =
-                evaluate( i, j, 1, 0 ) |
-                evaluate( i, j, 0, 1 ) | 
-                evaluate( i, j, 1, 1 ) |
-                evaluate( i, j, 1,-1 );
-            if ( r )
-                return r;
+            int      d = dirs[k];
+            uint64_t any = 0;
+
+            mask_shr( B, d, t );
+            for( int w=0; w<WORDS; w++ )
+                t[w] &= B[w];
+            mask_shr( t, 2*d, u );
+            for( int w=0; w<WORDS; w++ )
+                u[w] &= t[w];
+            mask_shr( B, 4*d, t );
+            for( int w=0; w<WORDS; w++ )
+                any |= u[w] & t[w];
+            if ( any )
+                return s+1;  // winner found!  1 or 2
         }
     }
     return 0;
 }
 
+/*
+ *  Win through the stone at (x,y) only: the stones next to it in a line
+ *  both ways, at most four each.  O(1), for the last move.
+ */
+static uint8_t get_bits( const void *b, int i, int j )
+{
+    return tictac_get( (const tictactoe_t *)b, i, j );
+}
+
+static uint8_t get_packed( const void *b, int i, int j )
+{
+    return tictac_pget( (const tictactoe_packed_t *)b, i, j );
+}
+
+static int check_move( const void *b, int x, int y, uint8_t (*get)( const void *, int, int ) )
+{
+    static const int dx[4] = { 1, 0, 1,  1 };
+    static const int dy[4] = { 0, 1, 1, -1 };
+    uint8_t s;
+
+    if ( x < 0 || x >= TICTACTOE_BOARD || y < 0 || y >= TICTACTOE_BOARD ||
+         !(s = get( b, x, y )) )
+        return 0;
+    for( int d=0; d<4; d++ )
+    {
+        int n = 1;
+        for( int sign=1; sign>=-1; sign-=2 )
+            for( int k=1; k<5; k++ )
+            {
+                int i = x + sign*k*dx[d], j = y + sign*k*dy[d];
+                if ( i < 0 || i >= TICTACTOE_BOARD ||
+                     j < 0 || j >= TICTACTOE_BOARD || get( b, i, j ) != s )
+                    break;
+                n++;
+            }
+        if ( n >= 5 )
+            return s;
+    }
+    return 0;
+}
+
+int tictac_check_move( const tictactoe_t *b, int x, int y )
+{
+    return check_move( b, x, y, get_bits );
+}
+
+int tictac_pcheck_move( const tictactoe_packed_t *p, int x, int y )
+{
+    return check_move( p, x, y, get_packed );
+}
+
 /* some elementary 16-bit randomness for actions! */
 int my_random(void)
 {
@@ -162,32 +435,42 @@ int my_random(void)
 /*
  *  Simple heuristic for our end.
  *  Returns zero on a successful choice
+ *
+ *  Only the empty squares next to a stone can score, so those come
+ *  from the bitboard instead of a look at all 900.
  */
 int tictac_auto( const tictactoe_t *b, int *x, int *y, uint8_t s )
 {
+    static const int nb[6] = { -1, -STRIDE, -STRIDE-1, 1, STRIDE, STRIDE+1 };
+    uint64_t near[ WORDS ], occ[ WORDS ];
     int best_v  = -1;
     int best_i  =  0;
     int best_j  =  0;
-    int m       = TICTACTOE_BOARD - 1;
-    int markers = 0;  // count the number of symbols
     int equal   = 0;
-    
-    for(int i=0; i<TICTACTOE_BOARD; i++ )
+
+    (void)s;    // stones of either side count the same
+    if ( !tictac_near( b, 1, near ) )
     {
-        for(int j=0; j<TICTACTOE_BOARD; j++ )
+        if ( tictac_moves( b, near ) != TICTACTOE_N )
+            return -1;  // full, or nowhere near -- cannot be
+        *x = TICTACTOE_BOARD / 2;
+        *y = TICTACTOE_BOARD / 2;
+        return 0;
+    }
+    for( int w=0; w<WORDS; w++ )
+        occ[w] = b->bits[0][w] | b->bits[1][w];
+    for( int w=0; w<WORDS; w++ )
+    {
+        for( uint64_t bits = near[w]; bits; bits &= bits-1 )
         {
-            if ( tictac_get(b,i,j) )
+            int q = 64*w + __builtin_ctzll( bits );
+            int v = 0;  // value of this action: six neighbours, pads are empty
+            for( int k=0; k<6; k++ )
             {
-                markers++;
-                continue;
+                int r = q + nb[k];
+                if ( r >= 0 && r < 64*WORDS && (occ[ r >> 6 ] >> (r & 63) & 1) )
+                    v++;
             }
-            int v = 0;  // value of this action
-            if ( i>0        && tictac_get(b,i-1,j  ) )  v++;
-            if ( j>0        && tictac_get(b,i,  j-1) )  v++;
-            if ( i>0 && j>0 && tictac_get(b,i-1,j-1) )  v++;
-            if ( i<m        && tictac_get(b,i+1,j  ) )  v++;
-            if ( j<m        && tictac_get(b,i,  j+1) )  v++;
-            if ( i<m && j<m && tictac_get(b,i+1,j+1) )  v++;
 
             if ( v < best_v )
                 continue;
@@ -202,20 +485,10 @@ int tictac_auto( const tictactoe_t *b, int *x, int *y, uint8_t s )
                 equal = 1;
             /* accept this as the best */
             best_v = v;
-            best_i = i;
-            best_j = j;
+            best_i = q % STRIDE;
+            best_j = q / STRIDE;
         }
     }
-    //printf( "auto loops done, best %d, equal=%d\n", best_v, equal );
-    
-    if ( best_v<0 )
-        return -1;
-    if ( markers == 0 )
-    {
-        best_i = TICTACTOE_BOARD / 2;
-        best_j = TICTACTOE_BOARD / 2;
-    }
-    //printf( "best: %d,%d\n", best_i, best_j );
     *x = best_i;
     *y = best_j;
     return 0;
@@ -263,6 +536,254 @@ void ask_move( tictactoe_t *b, uint8_t s )
     }
 }
         
+/*
+ *  Benchmark:  ./tictactoe bench
+ *
+ *  tictac_game_over() against the scan of a byte-per-square board it
+ *  replaced, on the same random positions.
+ */
+#include <stdlib.h>
+#include <time.h>
+
+static int bytes_game_over( const uint8_t *c )
+{
+    static const int dx[4] = { 1, 0, 1,  1 };
+    static const int dy[4] = { 0, 1, 1, -1 };
+
+    for( int j=0; j<TICTACTOE_BOARD; j++ )
+        for( int i=0; i<TICTACTOE_BOARD; i++ )
+        {
+            uint8_t s = c[ i + TICTACTOE_BOARD*j ];
+            if ( !s )
+                continue;
+            for( int d=0; d<4; d++ )
+            {
+                int i1 = i + 4*dx[d], j1 = j + 4*dy[d], k;
+                if ( i1 < 0 || i1 >= TICTACTOE_BOARD ||
+                     j1 < 0 || j1 >= TICTACTOE_BOARD )
+                    continue;
+                for( k=1; k<5; k++ )
+                    if ( c[ i + k*dx[d] + TICTACTOE_BOARD*(j + k*dy[d]) ] != s )
+                        break;
+                if ( k == 5 )
+                    return s;
+            }
+        }
+    return 0;
+}
+
+static double now_s( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench( void )
+{
+    enum { POS = 256, REPS = 200 };
+    static tictactoe_t b[ POS ];
+    static uint8_t     c[ POS ][ TICTACTOE_N ];
+    volatile int       sink = 0;
+    double             t0, t_bytes, t_bits;
+
+    srand( 1 );
+    for( int n=0; n<POS; n++ )
+    {
+        int stones = 20 + n;  // sparse to crowded
+        empty_board( &b[n] );
+        memset( c[n], 0, TICTACTOE_N );
+        for( int k=0; k<stones; k++ )
+        {
+            int i = rand() % TICTACTOE_BOARD, j = rand() % TICTACTOE_BOARD;
+            if ( !tictac_set( &b[n], i, j, 1 + (k & 1) ) )
+                c[n][ i + TICTACTOE_BOARD*j ] = 1 + (k & 1);
+        }
+        if ( tictac_game_over( &b[n] ) != bytes_game_over( c[n] ) )
+        {
+            printf( "Mismatch at position %d\n", n );
+            return -1;
+        }
+    }
+
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+            sink += bytes_game_over( c[n] );
+    t_bytes = now_s() - t0;
+
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+            sink += tictac_game_over( &b[n] );
+    t_bits = now_s() - t0;
+
+    printf( "game over, bytes:    %8.3f us\n", 1e6 * t_bytes / (REPS*POS) );
+    printf( "game over, bitboard: %8.3f us  (%.1fx)\n", 1e6 * t_bits / (REPS*POS), t_bytes / t_bits );
+
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+            sink += tictac_open( &b[n], 1, 3 ) + tictac_open( &b[n], 1, 4 );
+    printf( "open threes+fours:   %8.3f us\n", 1e6 * (now_s() - t0) / (REPS*POS) );
+
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+        {
+            int x, y;
+            sink += tictac_auto( &b[n], &x, &y, 1 );
+        }
+    printf( "auto:                %8.3f us\n", 1e6 * (now_s() - t0) / (REPS*POS) );
+
+    tictactoe_payload_t pl;
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+            sink += tictac_encode( &b[n], &pl );
+    printf( "encode:              %8.3f us\n", 1e6 * (now_s() - t0) / (REPS*POS) );
+    t0 = now_s();
+    for( int r=0; r<REPS; r++ )
+        for( int n=0; n<POS; n++ )
+            sink += tictac_decode( &pl, &b[n] );
+    printf( "decode:              %8.3f us\n", 1e6 * (now_s() - t0) / (REPS*POS) );
+    return 0;
+}
+
+/*
+ *  Random games, one move at a time: a fresh five must be found by
+ *  the last-move test exactly when the full scan finds it, packed or not.
+ *  Then moves/s of such games with either test, the full scan if scan.
+ */
+static int play( tictactoe_t *b, int scan, int *ok )
+{
+    int moves = 0, x, y;
+
+    empty_board( b );
+    while( moves < TICTACTOE_N )
+    {
+        uint8_t s = 1 + (moves & 1);
+        do
+        {
+            x = rand() % TICTACTOE_BOARD;
+            y = rand() % TICTACTOE_BOARD;
+        }
+        while ( tictac_set( b, x, y, s ) );
+        moves++;
+        if ( !ok )
+        {
+            if ( scan ? tictac_game_over( b ) : tictac_check_move( b, x, y ) )
+                break;
+            continue;
+        }
+
+        tictactoe_packed_t p;
+        int                r = tictac_check_move( b, x, y );
+        tictac_pack( b, &p );
+        if ( r != tictac_game_over( b ) || r != tictac_pcheck_move( &p, x, y ) )
+        {
+            printf( "Mismatch after %d moves at (%d,%d)\n", moves, x, y );
+            *ok = 0;
+            break;
+        }
+        if ( r )
+            break;
+    }
+    return moves;
+}
+
+/*
+ *  Codec round trips: board -> payload -> board, the payload as the
+ *  base 3 sum it is defined to be, and payload -> board -> payload
+ *  for any octets below 243
+ */
+static int codec_test( void )
+{
+    enum { BOARDS = 5000 };
+    tictactoe_t         b, b2;
+    tictactoe_payload_t p, p2;
+    int                 refused = 0;
+
+    for( int n=0; n<BOARDS; n++ )
+    {
+        int stones = rand() % TICTACTOE_N;
+        empty_board( &b );
+        for( int k=0; k<stones; k++ )
+            tictac_set( &b, rand() % TICTACTOE_BOARD, rand() % TICTACTOE_BOARD, 1 + rand() % 2 );
+        if ( tictac_encode( &b, &p ) || tictac_decode( &p, &b2 ) || memcmp( &b, &b2, sizeof(b) ) )
+        {
+            printf( "Board round trip failed, board %d\n", n );
+            return -1;
+        }
+        for( int k=0; k<TICTACTOE_N3; k++ )
+        {
+            int v = 0;
+            for( int q=4; q>=0; q-- )
+                v = 3*v + tictac_get( &b, (5*k+q) % TICTACTOE_BOARD, (5*k+q) / TICTACTOE_BOARD );
+            if ( p.bdata[k] != v )
+            {
+                printf( "Payload octet %d is %d, not %d\n", k, p.bdata[k], v );
+                return -1;
+            }
+        }
+
+        for( int k=0; k<TICTACTOE_N3; k++ )
+            p.bdata[k] = rand() % 243;
+        if ( tictac_decode( &p, &b ) || tictac_encode( &b, &p2 ) || memcmp( &p, &p2, sizeof(p) ) )
+        {
+            printf( "Payload round trip failed, payload %d\n", n );
+            return -1;
+        }
+        p.bdata[ rand() % TICTACTOE_N3 ] = 243 + rand() % 13;
+        refused += decode( &p, &b ) != 0;   // quietly, bad on purpose
+    }
+    if ( refused != BOARDS )
+    {
+        printf( "Decoded %d bad payloads of %d\n", BOARDS - refused, BOARDS );
+        return -1;
+    }
+    printf( "ok: %d codec round trips, %d bad payloads refused\n", BOARDS, refused );
+    return 0;
+}
+
+static int test( void )
+{
+    enum { GAMES = 2000 };
+    tictactoe_t b;
+    int         ok = 1, moves = 0, wins = 0;
+    double      t0, t_scan, t_move;
+
+    if ( codec_test() )
+        return -1;
+
+    srand( 2 );
+    for( int n=0; n<GAMES && ok; n++ )
+    {
+        moves += play( &b, 0, &ok );
+        wins  += tictac_game_over( &b ) != 0;
+    }
+    printf( "%s: %d games, %d moves, %d won\n", ok ? "ok" : "FAILED", GAMES, moves, wins );
+    if ( !ok )
+        return -1;
+
+    srand( 3 );
+    moves = 0;
+    t0 = now_s();
+    for( int n=0; n<GAMES; n++ )
+        moves += play( &b, 1, NULL );
+    t_scan = now_s() - t0;
+    printf( "full scan:  %10.0f moves/s\n", moves / t_scan );
+
+    srand( 3 );
+    moves = 0;
+    t0 = now_s();
+    for( int n=0; n<GAMES; n++ )
+        moves += play( &b, 0, NULL );
+    t_move = now_s() - t0;
+    printf( "last move:  %10.0f moves/s  (%.1fx)\n", moves / t_move, t_scan / t_move );
+    return 0;
+}
+
 int main( int argc, char **argv )
 {
     tictactoe_payload_t payload;
@@ -270,6 +791,11 @@ int main( int argc, char **argv )
     int res, x, y;
     int round = 0;
     
+    if ( argc > 1 && !strcmp( argv[1], "bench" ) )
+        return bench();
+    if ( argc > 1 && !strcmp( argv[1], "test" ) )
+        return test();
+
     empty_board( &b );
 
     /*
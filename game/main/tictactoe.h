@@ -5,14 +5,18 @@
 #define TICTACTOE_N     (30*30)   // number of squares
 #define TICTACTOE_N2       225    // data size with 4 squares-per-byte
 #define TICTACTOE_N3       180    // data size with 5 squares-per-byte (=30^2/5)
+#define TICTACTOE_STRIDE    31    // bits per row of a bitboard, one is padding
+#define TICTACTOE_WORDS     15    // 64-bit words per bitboard (930 bits)
 
 /*
- *  Internal representation, one square per byte
- *  0=empty, 1=cross, 2=circle
+ *  Internal representation, a bitboard per side: bits[0] crosses,
+ *  bits[1] circles, square (i,j) at bit i + 31*j.  The empty padding
+ *  column keeps shifted masks from wrapping to the next row, so lines
+ *  are found a word at a time.  All zero is the empty board.
  */
 typedef struct
 {
-    uint8_t board[ TICTACTOE_N + 100 ];
+    uint64_t bits[2][ TICTACTOE_WORDS ];
 } tictactoe_t;
 
 /*
@@ -25,13 +29,41 @@ typedef struct  __attribute__((__packed__))
 } tictactoe_payload_t;
 
 
+/*
+ *  Compact representation for storage and checksums
+ *  - four squares per octet, two bits each, square k = i + 30*j
+ *    in bits 2*(k%4) of octet k/4
+ */
+typedef struct  __attribute__((__packed__))
+{
+    uint8_t bdata[ TICTACTOE_N2 ];
+} tictactoe_packed_t;
+
+
 int     tictac_encode( const tictactoe_t *b, tictactoe_payload_t *p );
 int     tictac_decode( const tictactoe_payload_t *p, tictactoe_t *b );
 
-int     tictac_game_over( const tictactoe_t *b );
+int     tictac_game_over( const tictactoe_t *b );                     // full scan
+int     tictac_check_move( const tictactoe_t *b, int x, int y );      // five through (x,y)
 int     tictac_auto(      const tictactoe_t *b, int *x, int *y, uint8_t s );
 int     tictac_set(             tictactoe_t *b, int  i, int  j, uint8_t s );
 uint8_t tictac_get(       const tictactoe_t *b, int  i, int  j );
+int     tictac_moves(     const tictactoe_t *b, uint64_t *mask );     // empty squares, returns count
+int     tictac_near(      const tictactoe_t *b, int dist, uint64_t *mask );  // empty, dist from a stone
+int     tictac_open(      const tictactoe_t *b, uint8_t s, int n );   // open n-in-a-rows of s
+
+/*
+ *  32-bit board digest: XOR of tictac_dcell() over the marked squares,
+ *  so a move updates it with one more XOR.  Empty board is zero.
+ */
+uint32_t tictac_dcell(  int i, int j, uint8_t s );
+uint32_t tictac_digest( const tictactoe_t *b );
+
+int     tictac_pack(   const tictactoe_t        *b, tictactoe_packed_t *p );
+int     tictac_unpack( const tictactoe_packed_t *p, tictactoe_t        *b );
+uint8_t tictac_pget(   const tictactoe_packed_t *p, int i, int j );
+int     tictac_pset(         tictactoe_packed_t *p, int i, int j, uint8_t s );
+int     tictac_pcheck_move(  const tictactoe_packed_t *p, int x, int y );
 
 
 #endif
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "timerwheel.h"
+
+#define TW_MASK  (TW_SLOTS - 1)
+
+static inline uint64_t rotr64( uint64_t x, unsigned r )
+{
+    r &= 63;
+    return r ? (x >> r) | (x << (64 - r)) : x;
+}
+
+static void tw_link( timerwheel_t *tw, tw_node_t *n )
+{
+    uint32_t delta = n->tick - tw->now;   // tick is never behind now here
+
+    if ( delta < TW_SLOTS )
+    {
+        n->level = 0;
+        n->slot  = n->tick & TW_MASK;
+    }
+    else
+    {
+        /* park far timers in the last outer slot, they get re-cascaded */
+        uint32_t t = delta < (TW_SLOTS-1) << TW_BITS ? n->tick : tw->now + ((TW_SLOTS-1) << TW_BITS);
+        n->level = 1;
+        n->slot  = (t >> TW_BITS) & TW_MASK;
+    }
+
+    tw_node_t *h = &tw->wheel[n->level][n->slot];
+    n->next       = h->next;
+    n->prev       = h;
+    h->next->prev = n;
+    h->next       = n;
+    tw->occupied[n->level] |= 1ull << n->slot;
+}
+
+static void tw_unlink( timerwheel_t *tw, tw_node_t *n )
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    if ( tw->wheel[n->level][n->slot].next == &tw->wheel[n->level][n->slot] )
+        tw->occupied[n->level] &= ~(1ull << n->slot);
+    n->next = n->prev = 0;
+}
+
+void tw_init( timerwheel_t *tw, uint64_t now_ms )
+{
+    for( int l=0; l<2; l++ )
+        for( int s=0; s<TW_SLOTS; s++ )
+            tw->wheel[l][s].next = tw->wheel[l][s].prev = &tw->wheel[l][s];
+    tw->occupied[0] = tw->occupied[1] = 0;
+    tw->now = now_ms / TW_RES_MS;
+}
+
+int tw_armed( const tw_node_t *n )
+{
+    return n->prev != 0;
+}
+
+void tw_arm( timerwheel_t *tw, tw_node_t *n, uint64_t expires_ms )
+{
+    uint32_t tick = (expires_ms + TW_RES_MS - 1) / TW_RES_MS;  // never early
+
+    if ( tw_armed( n ) )
+        tw_unlink( tw, n );
+    n->tick = (int32_t)(tick - tw->now) > 0 ? tick : tw->now + 1;
+    tw_link( tw, n );
+}
+
+void tw_cancel( timerwheel_t *tw, tw_node_t *n )
+{
+    if ( tw_armed( n ) )
+        tw_unlink( tw, n );
+}
+
+tw_node_t *tw_expire( timerwheel_t *tw, uint64_t now_ms )
+{
+    uint32_t   target  = now_ms / TW_RES_MS;
+    tw_node_t *expired = 0;
+
+    while ( (int32_t)(target - tw->now) > 0 )
+    {
+        if ( !tw->occupied[0] && !tw->occupied[1] )
+        {
+            tw->now = target;   // nothing armed, jump
+            break;
+        }
+        tw->now++;
+
+        /* inner wheel wrapped -- pull the next outer slot in */
+        if ( !(tw->now & TW_MASK) )
+        {
+            tw_node_t *h = &tw->wheel[1][(tw->now >> TW_BITS) & TW_MASK];
+            while ( h->next != h )
+            {
+                tw_node_t *n = h->next;
+                tw_unlink( tw, n );
+                tw_link( tw, n );
+            }
+        }
+
+        tw_node_t *h = &tw->wheel[0][tw->now & TW_MASK];
+        while ( h->next != h )
+        {
+            tw_node_t *n = h->next;
+            tw_unlink( tw, n );
+            n->next = expired;
+            expired = n;
+        }
+    }
+    return expired;
+}
+
+uint64_t tw_next( const timerwheel_t *tw )
+{
+    uint64_t next = TW_NEVER;
+
+    if ( tw->occupied[0] )
+    {
+        uint32_t from = tw->now + 1;
+        uint32_t d    = __builtin_ctzll( rotr64( tw->occupied[0], from & TW_MASK ) );
+        next = (uint64_t)(from + d) * TW_RES_MS;
+    }
+    if ( tw->occupied[1] )
+    {
+        uint32_t from = (tw->now >> TW_BITS) + 1;
+        uint32_t d    = __builtin_ctzll( rotr64( tw->occupied[1], from & TW_MASK ) );
+        uint64_t t    = (uint64_t)((from + d) << TW_BITS) * TW_RES_MS;
+        if ( t < next )
+            next = t;
+    }
+    return next;
+}
@@ -0,0 +1,49 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+/*
+ *  Two level hierarchical timer wheel with intrusive nodes
+ *
+ *  - TW_RES_MS per tick, 64 ticks on the inner wheel (~2 s),
+ *    64 inner revolutions on the outer wheel (~2 min); anything
+ *    further out is parked on the outer wheel and re-cascaded
+ *  - arm, cancel and expiry are O(1); finding the next deadline
+ *    is a bitmap lookup
+ *  - not thread safe, the owner serializes access
+ */
+
+#define TW_RES_MS     32
+#define TW_BITS        6
+#define TW_SLOTS      (1 << TW_BITS)
+#define TW_NEVER      UINT64_MAX
+
+typedef struct tw_node
+{
+    struct tw_node *next;
+    struct tw_node *prev;
+    uint32_t        tick;     // expiry, in wheel ticks
+    uint8_t         level;    // which wheel we are on
+    uint8_t         slot;
+} tw_node_t;
+
+typedef struct
+{
+    tw_node_t  wheel[2][TW_SLOTS];  // list heads
+    uint64_t   occupied[2];         // non-empty slots
+    uint32_t   now;                 // current tick
+} timerwheel_t;
+
+void       tw_init(   timerwheel_t *tw, uint64_t now_ms );
+void       tw_arm(    timerwheel_t *tw, tw_node_t *n, uint64_t expires_ms );  // re-arms if armed
+void       tw_cancel( timerwheel_t *tw, tw_node_t *n );
+int        tw_armed(  const tw_node_t *n );
+
+// Advance to now_ms; returns the expired (now unarmed) nodes chained through ->next.
+tw_node_t *tw_expire( timerwheel_t *tw, uint64_t now_ms );
+
+// Earliest time (ms) at which tw_expire() may return something, or TW_NEVER.
+uint64_t   tw_next(   const timerwheel_t *tw );
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tourney.h"
+
+static int wants( const tourney_t *T, int i )
+{
+    return T->p[i].played < T->rounds;
+}
+
+static int can_meet( const tourney_t *T, int a, int b )
+{
+    return a != b && wants( T, b ) && !(T->p[a].met & (1u << b));
+}
+
+static int index_of( const tourney_t *T, uint8_t node )
+{
+    for( int i=0; i<T->n; i++ )
+        if ( T->p[i].node == node )
+            return i;
+    return -1;
+}
+
+/*
+ *  Lowest played count of those still playing, rounds if nobody is
+ */
+static int min_played( const tourney_t *T )
+{
+    int m = T->rounds;
+    for( int i=0; i<T->n; i++ )
+        if ( T->p[i].played < m )
+            m = T->p[i].played;
+    return m;
+}
+
+/*
+ *  Swiss: nobody left to meet, busy or not, means a bye (one point)
+ */
+static void give_byes( tourney_t *T )
+{
+    if ( T->mode != TOURNEY_SWISS )
+        return;
+    for( int a=0; a<T->n; a++ )
+    {
+        int b;
+        if ( !wants( T, a ) || T->p[a].opp >= 0 )
+            continue;
+        for( b=0; b<T->n; b++ )
+            if ( can_meet( T, a, b ) )
+                break;
+        if ( b == T->n )
+        {
+            T->p[a].played++;
+            T->p[a].score += 2;
+        }
+    }
+}
+
+static int finished( const tourney_t *T )
+{
+    for( int i=0; i<T->n; i++ )
+        if ( wants( T, i ) || T->p[i].opp >= 0 )
+            return 0;
+    return 1;
+}
+
+/********************************************************************************/
+
+int tourney_open( tourney_t *T, uint8_t mode, uint8_t rounds )
+{
+    if ( T->state == TOURNEY_OPEN || T->state == TOURNEY_RUNNING )
+        return -1;
+    if ( mode != TOURNEY_RR && mode != TOURNEY_SWISS )
+        return -1;
+    memset( T, 0, sizeof(tourney_t) );
+    T->mode   = mode;
+    T->rounds = rounds;
+    T->state  = TOURNEY_OPEN;
+    return 0;
+}
+
+int tourney_join( tourney_t *T, uint8_t node )
+{
+    if ( index_of( T, node ) >= 0 )
+        return 1;
+    if ( T->state != TOURNEY_OPEN || T->n >= TOURNEY_PLAYERS )
+        return -1;
+    memset( &T->p[T->n], 0, sizeof(tourney_player_t) );
+    T->p[T->n].node = node;
+    T->p[T->n].opp  = -1;
+    T->n++;
+    return 0;
+}
+
+int tourney_begin( tourney_t *T )
+{
+    if ( T->state != TOURNEY_OPEN || T->n < 2 )
+        return -1;
+    if ( T->mode == TOURNEY_RR || T->rounds > T->n - 1 )
+        T->rounds = T->n - 1;
+    T->state = TOURNEY_RUNNING;
+    return 0;
+}
+
+int tourney_member( const tourney_t *T, uint8_t node )
+{
+    return T->state == TOURNEY_RUNNING && index_of( T, node ) >= 0;
+}
+
+/*
+ *  Pair the free players, those with the fewest games first.
+ *  Round-robin takes the unmet opponent with the fewest games, Swiss
+ *  the closest score.  Player 1 is the one with fewer first moves.
+ */
+int tourney_next( tourney_t *T, lobby_pair_t *pairs, int max )
+{
+    int k = 0;
+
+    if ( T->state != TOURNEY_RUNNING )
+        return 0;
+    give_byes( T );
+
+    for( int pl=0; pl<T->rounds && k<max; pl++ )
+    {
+        for( int a=0; a<T->n && k<max; a++ )
+        {
+            tourney_player_t *pa = &T->p[a];
+            int best = -1, best_cost = 0;
+
+            if ( pa->played != pl || pa->opp >= 0 )
+                continue;
+            for( int b=0; b<T->n; b++ )
+            {
+                tourney_player_t *pb = &T->p[b];
+                int cost;
+
+                if ( pb->opp >= 0 || !can_meet( T, a, b ) )
+                    continue;
+                cost = pb->played - pa->played;
+                if ( cost < 0 )
+                    cost = -cost;
+                if ( T->mode == TOURNEY_SWISS )
+                    cost += 4*( pb->score > pa->score ? pb->score - pa->score : pa->score - pb->score );
+                if ( best < 0 || cost < best_cost )
+                {
+                    best      = b;
+                    best_cost = cost;
+                }
+            }
+            if ( best < 0 )
+                continue;
+
+            tourney_player_t *pb = &T->p[best];
+            pa->opp  = best;
+            pb->opp  = a;
+            pa->met |= 1u << best;
+            pb->met |= 1u << a;
+            if ( pa->firsts <= pb->firsts )
+            {
+                pairs[k].node_1 = pa->node;
+                pairs[k].node_2 = pb->node;
+                pa->firsts++;
+            }
+            else
+            {
+                pairs[k].node_1 = pb->node;
+                pairs[k].node_2 = pa->node;
+                pb->firsts++;
+            }
+            k++;
+        }
+    }
+    return k;
+}
+
+/*
+ *  Result of a game between n1 and n2, res 1 if n1 won, 2 if n2 won.
+ *  Returns -1 if it was not a tournament game, 0 if counted, 1 if a
+ *  round is complete and 2 if the tournament is over.
+ */
+int tourney_result( tourney_t *T, uint8_t n1, uint8_t n2, int res )
+{
+    int a = index_of( T, n1 );
+    int b = index_of( T, n2 );
+    int round;
+
+    if ( T->state != TOURNEY_RUNNING || a < 0 || b < 0 || T->p[a].opp != b )
+        return -1;
+
+    T->p[a].opp = T->p[b].opp = -1;
+    if ( res < 0 )   // never started: they may meet again
+    {
+        T->p[a].met &= ~(1u << b);
+        T->p[b].met &= ~(1u << a);
+        return 0;
+    }
+    T->p[a].played++;
+    T->p[b].played++;
+    T->p[a].score += res==1 ? 2 : res==0 ? 1 : 0;
+    T->p[b].score += res==2 ? 2 : res==0 ? 1 : 0;
+
+    give_byes( T );
+    if ( finished( T ) )
+    {
+        T->round = T->rounds;
+        T->state = TOURNEY_DONE;
+        return 2;
+    }
+    round = min_played( T );
+    if ( round > T->round )
+    {
+        T->round = round;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ *  Score, then the opponents' scores (Buchholz), then fewer games
+ */
+int tourney_standings( const tourney_t *T, uint8_t *idx )
+{
+    uint16_t buch[ TOURNEY_PLAYERS ];
+
+    for( int i=0; i<T->n; i++ )
+    {
+        buch[i] = 0;
+        for( int j=0; j<T->n; j++ )
+            if ( T->p[i].met & (1u << j) )
+                buch[i] += T->p[j].score;
+        idx[i] = i;
+    }
+    int better( int x, int y )
+    {
+        if ( T->p[x].score != T->p[y].score )
+            return T->p[x].score > T->p[y].score;
+        if ( buch[x] != buch[y] )
+            return buch[x] > buch[y];
+        return T->p[x].played < T->p[y].played;
+    }
+    for( int i=1; i<T->n; i++ )
+    {
+        uint8_t v = idx[i];
+        int     j = i;
+        while ( j > 0 && better( v, idx[j-1] ) )
+        {
+            idx[j] = idx[j-1];
+            j--;
+        }
+        idx[j] = v;
+    }
+    return T->n;
+}
+
+int tourney_summary( const tourney_t *T, char *buf, int len )
+{
+    uint8_t idx[ TOURNEY_PLAYERS ];
+    int     n   = tourney_standings( T, idx );
+    int     pos = 0;
+
+    buf[0] = '\0';
+    for( int i=0; i<n && pos < len; i++ )
+    {
+        const tourney_player_t *p = &T->p[ idx[i] ];
+        int w = snprintf( buf + pos, len - pos, "%s0x%02x %u%s", i ? ", " : "",
+                          (unsigned)p->node, (unsigned)(p->score/2), (p->score & 1) ? ".5" : "" );
+        if ( w < 0 || pos + w >= len )
+        {
+            buf[pos] = '\0';   // only whole entries
+            break;
+        }
+        pos += w;
+    }
+    return pos;
+}
@@ -0,0 +1,56 @@
+#ifndef TOURNEY_H
+#define TOURNEY_H
+
+#include <stdint.h>
+
+#include "lobby.h"
+
+/*
+ *  Tournaments of the game server
+ *
+ *  Round-robin: everybody plays everybody once.  Swiss: a fixed number
+ *  of games, each against an unmet player with a score as close as
+ *  possible.  Rounds are not waited for: a player who finishes a game
+ *  is paired again as soon as a suitable opponent is free, so the game
+ *  table never idles between rounds.
+ */
+
+#define TOURNEY_PLAYERS   32    // met[] is a bitmap
+#define TOURNEY_RR         1
+#define TOURNEY_SWISS      2
+
+#define TOURNEY_OFF        0
+#define TOURNEY_OPEN       1    // taking players
+#define TOURNEY_RUNNING    2
+#define TOURNEY_DONE       3
+
+typedef struct
+{
+    uint8_t   node;
+    uint8_t   played;
+    uint8_t   firsts;   // games as player 1
+    int8_t    opp;      // current opponent, -1 if free
+    uint16_t  score;    // in half points
+    uint32_t  met;      // opponents so far, by index
+} tourney_player_t;
+
+typedef struct
+{
+    uint8_t           mode;
+    uint8_t           state;
+    uint8_t           rounds;   // games per player
+    uint8_t           round;    // completed by everybody
+    int               n;
+    tourney_player_t  p[ TOURNEY_PLAYERS ];
+} tourney_t;
+
+int  tourney_open(   tourney_t *T, uint8_t mode, uint8_t rounds );  // rounds for Swiss only
+int  tourney_join(   tourney_t *T, uint8_t node );                  // 0 joined, 1 already in, -1 no
+int  tourney_begin(  tourney_t *T );
+int  tourney_member( const tourney_t *T, uint8_t node );            // running and playing in it
+int  tourney_next(   tourney_t *T, lobby_pair_t *pairs, int max );  // games to start now
+int  tourney_result( tourney_t *T, uint8_t n1, uint8_t n2, int res ); // res: 1, 2 winner, 0 tie, -1 not played
+int  tourney_standings( const tourney_t *T, uint8_t *idx );         // indices, best first
+int  tourney_summary(   const tourney_t *T, char *buf, int len );   // standings in one line
+
+#endif